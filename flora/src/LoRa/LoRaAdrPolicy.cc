@@ -0,0 +1,36 @@
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see http://www.gnu.org/licenses/.
+//
+
+#include "LoRaAdrPolicy.h"
+#include <omnetpp.h>
+#include <cstring>
+
+using namespace omnetpp;
+
+namespace flora {
+
+ILoRaAdrPolicy *ILoRaAdrPolicy::create(const char *method, int historyLength)
+{
+    if (historyLength < 1)
+        throw cRuntimeError("The ADR history length must be positive");
+    if (!strcmp(method, "max"))
+        return new LoRaMaxAdrPolicy(historyLength);
+    else if (!strcmp(method, "avg"))
+        return new LoRaAvgAdrPolicy(historyLength);
+    else
+        throw cRuntimeError("Unknown ADR method '%s'", method);
+}
+
+} // namespace flora
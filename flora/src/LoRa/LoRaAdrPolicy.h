@@ -0,0 +1,115 @@
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see http://www.gnu.org/licenses/.
+//
+
+#ifndef LORA_LORAADRPOLICY_H_
+#define LORA_LORAADRPOLICY_H_
+
+#include <cmath>
+#include <deque>
+#include <numeric>
+#include <vector>
+
+namespace flora {
+
+/**
+ * Condenses the SNIR history of one node into the SNR the network server's
+ * ADR compares against the required SNR. One instance per node; adding a
+ * sample must be cheap, it happens for every unique uplink.
+ */
+class ILoRaAdrPolicy
+{
+  public:
+    virtual ~ILoRaAdrPolicy() {}
+    /** Adds the SNIR (dB) of the best gateway for an uplink. */
+    virtual void addSNIR(double snir) = 0;
+    /** Returns the SNR (dB) of the history, NaN before the first sample. */
+    virtual double getSNR() const = 0;
+
+    /** Creates the policy selected by the adrMethod parameter, i.e. "max" or "avg". */
+    static ILoRaAdrPolicy *create(const char *method, int historyLength);
+};
+
+/**
+ * The last historyLength samples in a fixed ring buffer.
+ */
+class LoRaAdrHistory
+{
+  protected:
+    std::vector<double> samples;
+    size_t next = 0;
+    size_t size = 0;
+
+  public:
+    explicit LoRaAdrHistory(int historyLength) : samples(historyLength) {}
+    bool isFull() const { return size == samples.size(); }
+    size_t getSize() const { return size; }
+    /** Returns the oldest sample, which the next add() overwrites if the buffer is full. */
+    double getOldest() const { return samples[isFull() ? next : 0]; }
+    /** True right after the buffer wrapped around. */
+    bool isWrapped() const { return next == 0 && isFull(); }
+    double computeSum() const { return std::accumulate(samples.begin(), samples.begin() + size, 0.0); }
+    void add(double sample) {
+        samples[next] = sample;
+        next = (next + 1) % samples.size();
+        if (size < samples.size())
+            size++;
+    }
+};
+
+/** Maximum of the history, kept in a monotonic deque. */
+class LoRaMaxAdrPolicy : public ILoRaAdrPolicy
+{
+  protected:
+    size_t historyLength;
+    long numSamples = 0;
+    // (sample number, SNIR) with decreasing SNIR, the front is the maximum
+    std::deque<std::pair<long, double>> candidates;
+
+  public:
+    explicit LoRaMaxAdrPolicy(int historyLength) : historyLength(historyLength) {}
+    virtual void addSNIR(double snir) override {
+        while (!candidates.empty() && candidates.back().second <= snir)
+            candidates.pop_back();
+        candidates.emplace_back(numSamples++, snir);
+        if (candidates.front().first + (long)historyLength <= numSamples - 1)
+            candidates.pop_front();
+    }
+    virtual double getSNR() const override { return candidates.empty() ? NAN : candidates.front().second; }
+};
+
+/** Average of the history from a running sum. */
+class LoRaAvgAdrPolicy : public ILoRaAdrPolicy
+{
+  protected:
+    LoRaAdrHistory history;
+    double sum = 0;
+
+  public:
+    explicit LoRaAvgAdrPolicy(int historyLength) : history(historyLength) {}
+    virtual void addSNIR(double snir) override {
+        if (history.isFull())
+            sum -= history.getOldest();
+        history.add(snir);
+        sum += snir;
+        // resummed once per wrap around so that rounding errors do not accumulate
+        if (history.isWrapped())
+            sum = history.computeSum();
+    }
+    virtual double getSNR() const override { return history.getSize() == 0 ? NAN : sum / history.getSize(); }
+};
+
+} // namespace flora
+
+#endif /* LORA_LORAADRPOLICY_H_ */
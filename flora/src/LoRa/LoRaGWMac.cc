@@ -16,6 +16,7 @@
 #include "LoRaGWMac.h"
 #include "inet/common/ModuleAccess.h"
 #include "../LoRaPhy/LoRaPhyPreamble_m.h"
+#include "../LoRaPhy/LoRaAirtime.h"
 #include "inet/common/ProtocolTag_m.h"
 
 
@@ -40,6 +41,7 @@ void LoRaGWMac::initialize(int stage)
         const char *addressString = par("address");
         GW_forwardedDown = 0;
         GW_droppedDC = 0;
+        dutyCycle = par("dutyCycle");
         if (!strcmp(addressString, "auto")) {
             // assign automatic address
             address = MacAddress::generateAutoAddress();
@@ -118,13 +120,8 @@ void LoRaGWMac::handleUpperMessage(cMessage *msg)
 
 
         waitingForDC = true;
-        double delta;
-        if(frame->getLoRaSF() == 7) delta = 0.61696;
-        if(frame->getLoRaSF() == 8) delta = 1.23392;
-        if(frame->getLoRaSF() == 9) delta = 2.14016;
-        if(frame->getLoRaSF() == 10) delta = 4.28032;
-        if(frame->getLoRaSF() == 11) delta = 7.24992;
-        if(frame->getLoRaSF() == 12) delta = 14.49984;
+        const LoRaAirtime airtime = computeLoRaAirtime(frame->getPhy().getSpreadFactor(), frame->getPhy().getBandwidth(), frame->getPhy().getCodeRendundance(), pkt->getByteLength(), frame->getPhy().getUseHeader());
+        simtime_t delta = airtime.getDuration() / dutyCycle;
         scheduleAt(simTime() + delta, dutyCycleTimer);
         GW_forwardedDown++;
         pkt->addTagIfAbsent<PacketProtocolTag>()->setProtocol(&Protocol::apskPhy);
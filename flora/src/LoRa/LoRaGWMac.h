@@ -56,6 +56,7 @@ public:
 
 protected:
     MacAddress address;
+    double dutyCycle;
 
     IRadio *radio = nullptr;
     IRadio::TransmissionState transmissionState = IRadio::TRANSMISSION_STATE_UNDEFINED;
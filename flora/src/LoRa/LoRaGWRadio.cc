@@ -27,12 +27,24 @@ void LoRaGWRadio::initialize(int stage)
 {
     FlatRadioBase::initialize(stage);
     iAmGateway = par("iAmGateway").boolValue();
-    if (stage == INITSTAGE_LAST) {
+    if (stage == INITSTAGE_LOCAL) {
+        int numDemodulators = par("numDemodulators");
+        if (numDemodulators < 1)
+            throw cRuntimeError("The gateway needs at least one demodulator");
+        demodulatorSlots.resize(numDemodulators);
+        for (int i = numDemodulators - 1; i >= 0; i--) {
+            demodulatorSlots[i].index = i;
+            freeDemodulatorSlots.push_back(i);
+        }
+    }
+    else if (stage == INITSTAGE_LAST) {
         setRadioMode(RADIO_MODE_TRANSCEIVER);
         LoRaGWRadioReceptionStarted = registerSignal("LoRaGWRadioReceptionStarted");
         LoRaGWRadioReceptionFinishedCorrect = registerSignal("LoRaGWRadioReceptionFinishedCorrect");
+        LoRaGWRadioDemodulatorsBusy = registerSignal("LoRaGWRadioDemodulatorsBusy");
         LoRaGWRadioReceptionStarted_counter = 0;
         LoRaGWRadioReceptionFinishedCorrect_counter = 0;
+        LoRaGWRadioDemodulatorsBusy_counter = 0;
         iAmTransmiting = false;
     }
 }
@@ -41,6 +53,34 @@ void LoRaGWRadio::finish()
 {
     FlatRadioBase::finish();
     recordScalar("DER - Data Extraction Rate", double(LoRaGWRadioReceptionFinishedCorrect_counter)/LoRaGWRadioReceptionStarted_counter);
+    recordScalar("Receptions dropped - all demodulators busy", LoRaGWRadioDemodulatorsBusy_counter);
+}
+
+bool LoRaGWRadio::acquireDemodulator(cMessage *timer)
+{
+    if (freeDemodulatorSlots.empty())
+        return false;
+    DemodulatorSlot& slot = demodulatorSlots[freeDemodulatorSlots.back()];
+    freeDemodulatorSlots.pop_back();
+    slot.timer = timer;
+    timer->setContextPointer(&slot);
+    return true;
+}
+
+bool LoRaGWRadio::holdsDemodulator(const cMessage *timer) const
+{
+    auto slot = static_cast<const DemodulatorSlot *>(timer->getContextPointer());
+    return slot != nullptr && slot->timer == timer;
+}
+
+void LoRaGWRadio::releaseDemodulator(cMessage *timer)
+{
+    if (!holdsDemodulator(timer))
+        return;
+    auto slot = static_cast<DemodulatorSlot *>(timer->getContextPointer());
+    slot->timer = nullptr;
+    freeDemodulatorSlots.push_back(slot->index);
+    timer->setContextPointer(nullptr);
 }
 
 void LoRaGWRadio::handleSelfMessage(cMessage *message)
@@ -79,27 +119,16 @@ void LoRaGWRadio::handleUpperPacket(Packet *packet)
 {
     emit(packetReceivedFromUpperSignal, packet);
 
-    EV << packet->getDetailStringRepresentation(evFlags) << endl;
+    EV_DEBUG << packet->getDetailStringRepresentation(evFlags) << endl;
     const auto &frame = packet->peekAtFront<LoRaMacFrame>();
 
-    auto preamble = makeShared<LoRaPhyPreamble>();
+    auto preamble = preambleCache.getPreamble(frame->getPhy(), frame->getReceiverAddress());
 
-    preamble->setBandwidth(frame->getLoRaBW());
-    preamble->setCenterFrequency(frame->getLoRaCF());
-    preamble->setCodeRendundance(frame->getLoRaCR());
-    preamble->setPower(mW(frame->getLoRaTP()));
-    preamble->setSpreadFactor(frame->getLoRaSF());
-    preamble->setUseHeader(frame->getLoRaUseHeader());
-    preamble->setReceiverAddress(frame->getReceiverAddress());
-//    const auto & loraHeader =  packet->peekAtFront<LoRaMacFrame>();
-//    preamble->setReceiverAddress(loraHeader->getReceiverAddress());
-//
     auto signalPowerReq = packet->addTagIfAbsent<SignalPowerReq>();
-    signalPowerReq->setPower(mW(frame->getLoRaTP()));
-//
-    preamble->setChunkLength(b(16));
+    signalPowerReq->setPower(frame->getPhy().getPower());
+
     packet->insertAtFront(preamble);
-    EV << "Wysylam " << preamble->getPower() << " " << preamble->getSpreadFactor() << endl;
+    EV_DEBUG << "Sending packet with power " << preamble->getPhy().getPower() << ", SF: " << preamble->getPhy().getSpreadFactor() << endl;
 
 
     if (separateTransmissionParts)
@@ -179,10 +208,14 @@ void LoRaGWRadio::startReception(cMessage *timer, IRadioSignal::SignalPart part)
         auto isReceptionAttempted = medium->isReceptionAttempted(this, transmission, part);
         EV_INFO << "LoRaGWRadio Reception started: " << (isReceptionAttempted ? "attempting" : "not attempting") << " " << (WirelessSignal *)radioFrame << " " << IRadioSignal::getSignalPartName(part) << " as " << reception << endl;
         if (isReceptionAttempted) {
-            if(iAmGateway) {
-                concurrentReceptions.push_back(timer);
+            if (!iAmGateway || acquireDemodulator(timer))
+                receptionTimer = timer;
+            else {
+                EV_INFO << "LoRaGWRadio Reception dropped: all " << demodulatorSlots.size() << " demodulators are busy" << endl;
+                emit(LoRaGWRadioDemodulatorsBusy, true);
+                if (simTime() >= getSimulation()->getWarmupPeriod())
+                    LoRaGWRadioDemodulatorsBusy_counter++;
             }
-            receptionTimer = timer;
         }
     }
     else
@@ -193,7 +226,7 @@ void LoRaGWRadio::startReception(cMessage *timer, IRadioSignal::SignalPart part)
     //updateTransceiverPart();
     radioMode = RADIO_MODE_TRANSCEIVER;
     check_and_cast<LoRaMedium *>(medium.get())->emit(IRadioMedium::signalArrivalStartedSignal, check_and_cast<const cObject *>(reception));
-    if(iAmGateway) EV << "[MSDebug] start reception, size : " << concurrentReceptions.size() << endl;
+    if(iAmGateway) EV_DEBUG << "Start reception, size : " << demodulatorSlots.size() - freeDemodulatorSlots.size() << endl;
 }
 
 void LoRaGWRadio::continueReception(cMessage *timer)
@@ -203,25 +236,21 @@ void LoRaGWRadio::continueReception(cMessage *timer)
     auto radioFrame = static_cast<WirelessSignal *>(timer->getControlInfo());
     auto arrival = radioFrame->getArrival();
     auto reception = radioFrame->getReception();
-    if(iAmGateway) {
-        std::list<cMessage *>::iterator it;
-        for (it=concurrentReceptions.begin(); it!=concurrentReceptions.end(); it++) {
-            if(*it == timer) receptionTimer = timer;
-        }
-    }
+    if(iAmGateway && holdsDemodulator(timer))
+        receptionTimer = timer;
     if (timer == receptionTimer && isReceiverMode(radioMode) && arrival->getEndTime(previousPart) == simTime() && iAmTransmiting == false) {
         auto transmission = radioFrame->getTransmission();
         bool isReceptionSuccessful = medium->isReceptionSuccessful(this, transmission, previousPart);
         EV_INFO << "LoRaGWRadio Reception ended: " << (isReceptionSuccessful ? "successfully" : "unsuccessfully") << " for " << (IWirelessSignal *)radioFrame << " " << IRadioSignal::getSignalPartName(previousPart) << " as " << reception << endl;
         if (!isReceptionSuccessful) {
             receptionTimer = nullptr;
-            if(iAmGateway) concurrentReceptions.remove(timer);
+            if(iAmGateway) releaseDemodulator(timer);
         }
         auto isReceptionAttempted = medium->isReceptionAttempted(this, transmission, nextPart);
         EV_INFO << "LoRaGWRadio Reception started: " << (isReceptionAttempted ? "attempting" : "not attempting") << " " << (IWirelessSignal *)radioFrame << " " << IRadioSignal::getSignalPartName(nextPart) << " as " << reception << endl;
         if (!isReceptionAttempted) {
             receptionTimer = nullptr;
-            if(iAmGateway) concurrentReceptions.remove(timer);
+            if(iAmGateway) releaseDemodulator(timer);
         }
     }
     else {
@@ -241,12 +270,8 @@ void LoRaGWRadio::endReception(cMessage *timer)
     auto radioFrame = static_cast<WirelessSignal *>(timer->getControlInfo());
     auto arrival = radioFrame->getArrival();
     auto reception = radioFrame->getReception();
-    std::list<cMessage *>::iterator it;
-    if(iAmGateway) {
-        for (it=concurrentReceptions.begin(); it!=concurrentReceptions.end(); it++) {
-            if(*it == timer) receptionTimer = timer;
-        }
-    }
+    if(iAmGateway && holdsDemodulator(timer))
+        receptionTimer = timer;
     if (timer == receptionTimer && isReceiverMode(radioMode) && arrival->getEndTime() == simTime() && iAmTransmiting == false) {
         auto transmission = radioFrame->getTransmission();
 // TODO: this would draw twice from the random number generator in isReceptionSuccessful: auto isReceptionSuccessful = medium->isReceptionSuccessful(this, transmission, part);
@@ -259,11 +284,11 @@ void LoRaGWRadio::endReception(cMessage *timer)
             emit(LoRaGWRadioReceptionFinishedCorrect, true);
             if (simTime() >= getSimulation()->getWarmupPeriod())
                 LoRaGWRadioReceptionFinishedCorrect_counter++;
-            EV << macFrame->getCompleteStringRepresentation(evFlags) << endl;
+            EV_DEBUG << macFrame->getCompleteStringRepresentation(evFlags) << endl;
             sendUp(macFrame);
         }
         receptionTimer = nullptr;
-        if(iAmGateway) concurrentReceptions.remove(timer);
+        if(iAmGateway) releaseDemodulator(timer);
     }
     else
         EV_INFO << "LoRaGWRadio Reception ended: ignoring " << (IWirelessSignal *)radioFrame << " " << IRadioSignal::getSignalPartName(part) << " as " << reception << endl;
@@ -271,6 +296,8 @@ void LoRaGWRadio::endReception(cMessage *timer)
     //updateTransceiverPart();
     radioMode = RADIO_MODE_TRANSCEIVER;
     check_and_cast<LoRaMedium *>(medium.get())->emit(IRadioMedium::signalArrivalEndedSignal, check_and_cast<const cObject *>(reception));
+    // also frees the slot of a reception that ended while transmitting
+    if(iAmGateway) releaseDemodulator(timer);
     delete timer;
 }
 
@@ -280,10 +307,9 @@ void LoRaGWRadio::abortReception(cMessage *timer)
     auto part = (IRadioSignal::SignalPart)timer->getKind();
     auto reception = radioFrame->getReception();
     EV_INFO << "LoRaGWRadio Reception aborted: for " << (IWirelessSignal *)radioFrame << " " << IRadioSignal::getSignalPartName(part) << " as " << reception << endl;
-    if (timer == receptionTimer) {
-        if(iAmGateway) concurrentReceptions.remove(timer);
+    if(iAmGateway) releaseDemodulator(timer);
+    if (timer == receptionTimer)
         receptionTimer = nullptr;
-    }
     updateTransceiverState();
     updateTransceiverPart();
 }
@@ -25,6 +25,7 @@
 #include "inet/physicallayer/wireless/common//medium/RadioMedium.h"
 #include "LoRaPhy/LoRaMedium.h"
 #include "inet/common/LayeredProtocolBase.h"
+#include "LoRaPhy/LoRaPhyPreambleCache.h"
 
 namespace flora {
 
@@ -32,6 +33,8 @@ class LoRaGWRadio : public FlatRadioBase {
 private:
     void completeRadioModeSwitch(RadioMode newRadioMode);
 protected:
+    LoRaPhyPreambleCache preambleCache;
+
     void initialize(int stage) override;
     virtual void finish() override;
     virtual void handleSelfMessage(cMessage *message) override;
@@ -51,17 +54,31 @@ protected:
     virtual void endReception(cMessage *timer) override;
     virtual void abortReception(cMessage *timer) override;
 
+    /**
+     * Demodulator paths of the concentrator (8 on the SX1301, 16 on the
+     * SX1302). A reception holds a slot from its start until it ends or
+     * fails; the timer's context pointer refers to its slot.
+     */
+    struct DemodulatorSlot {
+        cMessage *timer = nullptr;
+        int index = -1;
+    };
+    std::vector<DemodulatorSlot> demodulatorSlots;
+    std::vector<int> freeDemodulatorSlots;
+
+    virtual bool acquireDemodulator(cMessage *timer);
+    virtual bool holdsDemodulator(const cMessage *timer) const;
+    virtual void releaseDemodulator(cMessage *timer);
 
 public:
     bool iAmGateway;
 
-    std::list<cMessage *>concurrentReceptions;
-    std::list<cMessage *>concurrentTransmissions;
-
     long LoRaGWRadioReceptionStarted_counter;
     long LoRaGWRadioReceptionFinishedCorrect_counter;
+    long LoRaGWRadioDemodulatorsBusy_counter;
     simsignal_t LoRaGWRadioReceptionStarted;
     simsignal_t LoRaGWRadioReceptionFinishedCorrect;
+    simsignal_t LoRaGWRadioDemodulatorsBusy;
 };
 
 }
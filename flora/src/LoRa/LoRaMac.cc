@@ -52,8 +52,9 @@ void LoRaMac::initialize(int stage)
         EV << "Initializing stage 0\n";
 
         //maxQueueSize = par("maxQueueSize");
-        headerLength = par("headerLength");
-        ackLength = par("ackLength");
+        //the inherited CsmaCaMac parameters are in bits
+        headerLength = B(b(par("headerLength").intValue())).get();
+        ackLength = B(b(par("ackLength").intValue())).get();
         ackTimeout = par("ackTimeout");
         retryLimit = par("retryLimit");
 
@@ -414,17 +415,11 @@ Packet *LoRaMac::encapsulate(Packet *msg)
     auto tag = msg->getTag<LoRaTag>();
 
     frame->setTransmitterAddress(address);
-    frame->setLoRaTP(tag->getPower().get());
-    frame->setLoRaCF(tag->getCenterFrequency());
-    frame->setLoRaSF(tag->getSpreadFactor());
-    frame->setLoRaBW(tag->getBandwidth());
-    frame->setLoRaCR(tag->getCodeRendundance());
+    frame->setPhy(tag->getPhy());
     frame->setSequenceNumber(sequenceNumber);
     frame->setReceiverAddress(MacAddress::BROADCAST_ADDRESS);
 
     ++sequenceNumber;
-    //frame->setLoRaUseHeader(cInfo->getLoRaUseHeader());
-    frame->setLoRaUseHeader(tag->getUseHeader());
 
     msg->insertAtFront(frame);
 
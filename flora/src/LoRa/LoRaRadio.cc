@@ -51,6 +51,20 @@ void LoRaRadio::initialize(int stage)
 LoRaRadio::~LoRaRadio() {
 }
 
+void LoRaRadio::setLoRaCF(units::values::Hz newCF)
+{
+    loRaCF = newCF;
+    check_and_cast<LoRaMedium *>(medium.get())->updateRadioChannel(this);
+}
+
+void LoRaRadio::completeRadioModeSwitch(RadioMode newRadioMode)
+{
+    bool wasReceiving = radioMode == RADIO_MODE_RECEIVER || radioMode == RADIO_MODE_TRANSCEIVER;
+    NarrowbandRadioBase::completeRadioModeSwitch(newRadioMode);
+    if (!wasReceiving && (newRadioMode == RADIO_MODE_RECEIVER || newRadioMode == RADIO_MODE_TRANSCEIVER))
+        check_and_cast<LoRaMedium *>(medium.get())->pickUpTransmissions(this);
+}
+
 std::ostream& LoRaRadio::printToStream(std::ostream& stream, int level, int evFlags) const
 {
     stream << static_cast<const cSimpleModule *>(this);
@@ -182,22 +196,12 @@ void LoRaRadio::handleUpperPacket(Packet *packet)
     emit(packetReceivedFromUpperSignal, packet);
     if (isTransmitterMode(radioMode)) {
         auto tag = packet->removeTag<LoRaTag>();
-        auto preamble = makeShared<LoRaPhyPreamble>();
-
-        preamble->setBandwidth(tag->getBandwidth());
-        preamble->setCenterFrequency(tag->getCenterFrequency());
-        preamble->setCodeRendundance(tag->getCodeRendundance());
-        preamble->setPower(tag->getPower());
-        preamble->setSpreadFactor(tag->getSpreadFactor());
-        preamble->setUseHeader(tag->getUseHeader());
         const auto & loraHeader =  packet->peekAtFront<LoRaMacFrame>();
-        preamble->setReceiverAddress(loraHeader->getReceiverAddress());
 
         auto signalPowerReq = packet->addTagIfAbsent<SignalPowerReq>();
-        signalPowerReq->setPower(tag->getPower());
+        signalPowerReq->setPower(tag->getPhy().getPower());
 
-        preamble->setChunkLength(b(16));
-        packet->insertAtFront(preamble);
+        packet->insertAtFront(preambleCache.getPreamble(tag->getPhy(), loraHeader->getReceiverAddress()));
 
         if (transmissionTimer->isScheduled())
             throw cRuntimeError("Received frame from upper layer while already transmitting.");
@@ -390,13 +394,7 @@ void LoRaRadio::decapsulate(Packet *packet) const
 {
     auto tag = packet->addTag<LoRaTag>();
     auto preamble = packet->popAtFront<LoRaPhyPreamble>();
-
-    tag->setBandwidth(preamble->getBandwidth());
-    tag->setCenterFrequency(preamble->getCenterFrequency());
-    tag->setCodeRendundance(preamble->getCodeRendundance());
-    tag->setPower(preamble->getPower());
-    tag->setSpreadFactor(preamble->getSpreadFactor());
-    tag->setUseHeader(preamble->getUseHeader());
+    tag->setPhy(preamble->getPhy());
 }
 
 void LoRaRadio::endReception(cMessage *timer)
@@ -411,14 +409,16 @@ void LoRaRadio::endReception(cMessage *timer)
         // TODO: this would draw twice from the random number generator in isReceptionSuccessful: auto isReceptionSuccessful = medium->isReceptionSuccessful(this, transmission, part);
         auto isReceptionSuccessful = medium->getReceptionDecision(this, signal->getListening(), transmission, part)->isReceptionSuccessful();
         EV_INFO << "Reception ended: " << (isReceptionSuccessful ? "\x1b[1msuccessfully\x1b[0m" : "\x1b[1munsuccessfully\x1b[0m") << " for " << (IWirelessSignal *)signal << " " << IRadioSignal::getSignalPartName(part) << " as " << reception << endl;
-        auto macFrame = medium->receivePacket(this, signal);
-        take(macFrame);
-        decapsulate(macFrame);
-        if (isReceptionSuccessful)
+        // a failed reception is dropped here anyway, so its packet is not even built
+        if (isReceptionSuccessful) {
+            auto macFrame = medium->receivePacket(this, signal);
+            take(macFrame);
+            decapsulate(macFrame);
             sendUp(macFrame);
+        }
         else {
+            check_and_cast<LoRaMedium *>(medium.get())->dropReception(this, signal);
             emit(LoRaRadio::droppedPacket, 0);
-            delete macFrame;
         }
         receptionTimer = nullptr;
         emit(receptionEndedSignal, check_and_cast<const cObject *>(reception));
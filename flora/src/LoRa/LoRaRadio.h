@@ -23,6 +23,7 @@
 #include "inet/physicallayer/wireless/common/contract/packetlevel/IRadioMedium.h"
 //#include "inet/physicallayer/wireless/common/base/packetlevel/FlatRadioBase.h"
 #include "inet/physicallayer/wireless/common/base/packetlevel/NarrowbandRadioBase.h"
+#include "LoRaPhy/LoRaPhyPreambleCache.h"
 
 using namespace inet;
 using namespace inet::physicallayer;
@@ -46,7 +47,7 @@ public:
 //  double currentTxPower;
   //LoRa physical layer parameters
   double loRaTP;
-  units::values::Hz loRaCF;
+  units::values::Hz loRaCF = units::values::Hz(0); // set by the application at INITSTAGE_LOCAL
   int loRaSF;
   units::values::Hz loRaBW;
   int loRaCR;
@@ -57,6 +58,8 @@ private:
   void startRadioModeSwitch(RadioMode newRadioMode, simtime_t switchingTime);
 
 protected:
+  LoRaPhyPreambleCache preambleCache;
+
   virtual void initialize(int stage) override;
 
   virtual void handleMessageWhenDown(cMessage *message) override;
@@ -78,6 +81,8 @@ protected:
   //virtual void handleCrashOperation(LifecycleOperation *operation) override;
 
 
+  virtual void completeRadioModeSwitch(RadioMode newRadioMode) override;
+
   virtual void startTransmission(Packet *macFrame, IRadioSignal::SignalPart part) override;
   virtual void continueTransmission() override;
   virtual void endTransmission() override;
@@ -105,6 +110,9 @@ public:
 
   virtual int getId() const override { return id; }
 
+  /** Changes the center frequency and moves the radio to the matching channel registry of the medium. */
+  virtual void setLoRaCF(units::values::Hz newCF);
+
   virtual std::ostream& printToStream(std::ostream& stream, int level, int evFlags = 0) const override;
 
   virtual const IAntenna *getAntenna() const override { return antenna; }
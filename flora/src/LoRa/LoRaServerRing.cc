@@ -0,0 +1,63 @@
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see http://www.gnu.org/licenses/.
+//
+
+#include "LoRaServerRing.h"
+#include <algorithm>
+
+namespace flora {
+
+// 64 bit FNV-1a, deterministic across runs and platforms unlike std::hash
+static uint64_t hashString(const std::string& string)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (unsigned char c : string) {
+        hash ^= c;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// splitmix64 finalizer, spreads the sequential device addresses over the ring
+static uint64_t mixHash(uint64_t x)
+{
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+void LoRaServerRing::addServer(const std::string& name, int index, int numVirtualNodes)
+{
+    for (int i = 0; i < numVirtualNodes; i++)
+        points.emplace_back(mixHash(hashString(name + "#" + std::to_string(i))), index);
+}
+
+void LoRaServerRing::sort()
+{
+    std::sort(points.begin(), points.end());
+}
+
+int LoRaServerRing::findServer(const MacAddress& deviceAddress) const
+{
+    if (points.empty())
+        return -1;
+    // the first point clockwise from the device
+    uint64_t point = mixHash(deviceAddress.getInt());
+    auto it = std::lower_bound(points.begin(), points.end(), std::make_pair(point, 0));
+    if (it == points.end())
+        it = points.begin();
+    return it->second;
+}
+
+} // namespace flora
@@ -0,0 +1,52 @@
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see http://www.gnu.org/licenses/.
+//
+
+#ifndef LORA_LORASERVERRING_H_
+#define LORA_LORASERVERRING_H_
+
+#include "inet/linklayer/common/MacAddress.h"
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace inet;
+
+namespace flora {
+
+/**
+ * Consistent hash ring mapping end devices to network servers. Every server
+ * owns numVirtualNodes points derived from its name, so adding or removing
+ * a server only moves the devices of its own arcs. Packet forwarders route
+ * uplinks with it, network servers use it to tell their own devices.
+ */
+class LoRaServerRing
+{
+  protected:
+    // (point, server index), sorted by point
+    std::vector<std::pair<uint64_t, int>> points;
+
+  public:
+    /** Adds the points of a server, must be followed by sort() before lookups. */
+    void addServer(const std::string& name, int index, int numVirtualNodes);
+    void sort();
+    bool isEmpty() const { return points.empty(); }
+    /** Returns the index of the server owning the device, -1 if the ring is empty. */
+    int findServer(const MacAddress& deviceAddress) const;
+};
+
+} // namespace flora
+
+#endif /* LORA_LORASERVERRING_H_ */
@@ -0,0 +1,237 @@
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see http://www.gnu.org/licenses/.
+//
+
+#include "LoRaTelemetryStore.h"
+#include <cinttypes>
+#include <cstring>
+
+namespace flora {
+
+static const char MAGIC[8] = {'F', 'L', 'O', 'R', 'A', 'T', 'L', 'M'};
+
+static void writeVarint(std::string& buffer, uint64_t value)
+{
+    while (value >= 0x80) {
+        buffer.push_back((char)(value | 0x80));
+        value >>= 7;
+    }
+    buffer.push_back((char)value);
+}
+
+static uint64_t readVarint(std::istream& stream)
+{
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        int c = stream.get();
+        if (c == EOF)
+            throw cRuntimeError("Unexpected end of telemetry file");
+        value |= (uint64_t)(c & 0x7f) << shift;
+        if (!(c & 0x80))
+            return value;
+    }
+    throw cRuntimeError("Malformed varint in telemetry file");
+}
+
+static void writeFixed(std::string& buffer, uint64_t value, int size)
+{
+    for (int i = 0; i < size; i++)
+        buffer.push_back((char)(value >> (8 * i)));
+}
+
+static uint64_t readFixed(std::istream& stream, int size)
+{
+    unsigned char bytes[8];
+    if (!stream.read(reinterpret_cast<char *>(bytes), size))
+        throw cRuntimeError("Unexpected end of telemetry file");
+    uint64_t value = 0;
+    for (int i = 0; i < size; i++)
+        value |= (uint64_t)bytes[i] << (8 * i);
+    return value;
+}
+
+static uint32_t floatBits(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static float bitsFloat(uint32_t bits)
+{
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static uint64_t zigzag(int64_t value) { return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63); }
+static int64_t unzigzag(uint64_t value) { return (int64_t)(value >> 1) ^ -(int64_t)(value & 1); }
+
+void LoRaTelemetryStore::open(const char *fileName, size_t blockSize)
+{
+    this->fileName = fileName;
+    this->blockSize = blockSize;
+    file.open(fileName, std::ios::binary | std::ios::trunc);
+    if (!file)
+        throw cRuntimeError("Cannot open telemetry file '%s'", fileName);
+    std::string buffer(MAGIC, sizeof(MAGIC));
+    writeFixed(buffer, VERSION, 4);
+    file.write(buffer.data(), buffer.size());
+    for (auto column : {&deviceColumn, &sequenceNumberColumn})
+        column->reserve(blockSize);
+    timeColumn.reserve(blockSize);
+    for (auto column : {&snirColumn, &rssiColumn, &marginColumn})
+        column->reserve(blockSize);
+}
+
+void LoRaTelemetryStore::close()
+{
+    if (!file.is_open())
+        return;
+    flushBlock();
+    uint64_t devicesOffset = file.tellp();
+    std::string buffer;
+    buffer.push_back('D');
+    writeVarint(buffer, devices.size());
+    for (auto address : devices)
+        writeVarint(buffer, address);
+    writeFixed(buffer, devicesOffset, 8);
+    file.write(buffer.data(), buffer.size());
+    file.close();
+    if (file.fail())
+        throw cRuntimeError("Cannot write telemetry file '%s'", fileName.c_str());
+}
+
+void LoRaTelemetryStore::append(int device, int sequenceNumber, double snir, double rssi, double margin)
+{
+    if (!file.is_open())
+        return;
+    deviceColumn.push_back(device);
+    timeColumn.push_back(simTime().raw());
+    sequenceNumberColumn.push_back(sequenceNumber);
+    snirColumn.push_back(snir);
+    rssiColumn.push_back(rssi);
+    marginColumn.push_back(margin);
+    numRows++;
+    if (deviceColumn.size() >= blockSize)
+        flushBlock();
+}
+
+void LoRaTelemetryStore::flushBlock()
+{
+    size_t size = deviceColumn.size();
+    if (size == 0)
+        return;
+    std::string buffer;
+    buffer.push_back('B');
+    writeVarint(buffer, size);
+    for (int device : deviceColumn)
+        writeVarint(buffer, device);
+    int64_t previousTime = 0;
+    for (int64_t time : timeColumn) {
+        writeVarint(buffer, time - previousTime);
+        previousTime = time;
+    }
+    for (int sequenceNumber : sequenceNumberColumn)
+        writeVarint(buffer, zigzag(sequenceNumber));
+    for (auto column : {&snirColumn, &rssiColumn, &marginColumn})
+        for (float value : *column)
+            writeFixed(buffer, floatBits(value), 4);
+    file.write(buffer.data(), buffer.size());
+    deviceColumn.clear();
+    timeColumn.clear();
+    sequenceNumberColumn.clear();
+    snirColumn.clear();
+    rssiColumn.clear();
+    marginColumn.clear();
+}
+
+void LoRaTelemetryStore::read(const char *fileName, std::vector<uint64_t>& devices, std::function<void (const Row&)> f)
+{
+    std::ifstream file(fileName, std::ios::binary);
+    char magic[sizeof(MAGIC)];
+    if (!file.read(magic, sizeof(magic)) || memcmp(magic, MAGIC, sizeof(MAGIC)) != 0 || readFixed(file, 4) != VERSION)
+        throw cRuntimeError("'%s' is not a telemetry file of version %u", fileName, VERSION);
+    std::streamoff blocksOffset = file.tellg();
+
+    // the device table is written last, its offset closes the file
+    file.seekg(-8, std::ios::end);
+    std::streamoff devicesOffset = readFixed(file, 8);
+    file.seekg(devicesOffset);
+    if (file.get() != 'D')
+        throw cRuntimeError("Malformed telemetry file '%s'", fileName);
+    devices.resize(readVarint(file));
+    for (auto& address : devices)
+        address = readVarint(file);
+
+    file.seekg(blocksOffset);
+    std::vector<Row> rows;
+    while (file.tellg() < devicesOffset) {
+        if (file.get() != 'B')
+            throw cRuntimeError("Malformed telemetry file '%s'", fileName);
+        size_t size = readVarint(file);
+        rows.resize(size);
+        for (auto& row : rows) {
+            row.device = readVarint(file);
+            if (row.device < 0 || row.device >= (int)devices.size())
+                throw cRuntimeError("Malformed telemetry file '%s'", fileName);
+        }
+        int64_t time = 0;
+        for (auto& row : rows) {
+            time += readVarint(file);
+            row.time.setRaw(time);
+        }
+        for (auto& row : rows)
+            row.sequenceNumber = unzigzag(readVarint(file));
+        for (auto& row : rows)
+            row.snir = bitsFloat(readFixed(file, 4));
+        for (auto& row : rows)
+            row.rssi = bitsFloat(readFixed(file, 4));
+        for (auto& row : rows)
+            row.margin = bitsFloat(readFixed(file, 4));
+        for (auto& row : rows)
+            f(row);
+    }
+}
+
+void LoRaTelemetryStore::exportCsv(const char *fileName, const char *csvFileName)
+{
+    std::ofstream csv(csvFileName);
+    if (!csv)
+        throw cRuntimeError("Cannot open '%s'", csvFileName);
+    csv << "address,time,sequenceNumber,snir,rssi,margin\n";
+    csv.precision(9);
+    // absent values are left empty
+    auto printValue = [&] (float value) { if (!std::isnan(value)) csv << value; };
+    std::vector<uint64_t> devices;
+    read(fileName, devices, [&] (const Row& row) {
+        char address[24];
+        snprintf(address, sizeof(address), "%012" PRIx64, devices[row.device]);
+        csv << address << ',' << row.time.str() << ',';
+        if (row.sequenceNumber != -1)
+            csv << row.sequenceNumber;
+        csv << ',';
+        printValue(row.snir);
+        csv << ',';
+        printValue(row.rssi);
+        csv << ',';
+        printValue(row.margin);
+        csv << '\n';
+    });
+    csv.close();
+    if (csv.fail())
+        throw cRuntimeError("Cannot write '%s'", csvFileName);
+}
+
+} // namespace flora
@@ -0,0 +1,112 @@
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see http://www.gnu.org/licenses/.
+//
+
+#ifndef LORA_LORATELEMETRYSTORE_H_
+#define LORA_LORATELEMETRYSTORE_H_
+
+#include <omnetpp.h>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+
+using namespace omnetpp;
+
+namespace flora {
+
+/**
+ * Per device time series of the network server, kept in columns instead of
+ * one cOutVector per device and series. Rows are buffered in memory and
+ * written as blocks of delta and varint encoded columns:
+ *
+ *   file   = "FLORATLM" uint32(version) block* devices uint64(offset of devices)
+ *   block  = 'B' varint(numRows) column(device) column(time) column(seq)
+ *            float32(snir)[numRows] float32(rssi)[numRows] float32(margin)[numRows]
+ *   device = varint(device index) per row
+ *   time   = varint(raw simtime delta to the previous row of the block)
+ *   seq    = varint(zigzag(sequence number)), -1 if absent
+ *   devices = 'D' varint(numDevices) varint(MAC address)[numDevices]
+ *
+ * Fixed size integers and floats are little endian, floats NaN if absent.
+ * Uplink rows carry SNIR (dB), RSSI (dBm) and sequence number, ADR rows the
+ * computed SNR margin (dB). The device table is only known at the end of the
+ * run, the trailing offset lets read() load it before the blocks.
+ *
+ * scavetool cannot open these files; exportCsv() (NetworkServerApp's
+ * exportTelemetryCsv parameter) converts one to CSV for analysis.
+ */
+class LoRaTelemetryStore
+{
+  public:
+    struct Row {
+        int device;
+        simtime_t time;
+        int sequenceNumber;
+        float snir;
+        float rssi;
+        float margin;
+    };
+
+  protected:
+    static const uint32_t VERSION = 2;
+
+    std::string fileName;
+    std::ofstream file;
+    size_t blockSize = 0;
+    long numRows = 0;
+    std::vector<uint64_t> devices; // MAC address by device index
+
+    /** @name Columns of the current block */
+    //@{
+    std::vector<int> deviceColumn;
+    std::vector<int64_t> timeColumn; // raw simtime
+    std::vector<int> sequenceNumberColumn;
+    std::vector<float> snirColumn;
+    std::vector<float> rssiColumn;
+    std::vector<float> marginColumn;
+    //@}
+
+  protected:
+    virtual void append(int device, int sequenceNumber, double snir, double rssi, double margin);
+    virtual void flushBlock();
+
+  public:
+    virtual ~LoRaTelemetryStore() {}
+
+    virtual void open(const char *fileName, size_t blockSize);
+    /** Writes the last block and the device table, must be called at the end of the run. */
+    virtual void close();
+    bool isOpen() const { return file.is_open(); }
+    long getNumRows() const { return numRows; }
+
+    /** Registers a device and returns its dense index. */
+    int addDevice(uint64_t address) { devices.push_back(address); return devices.size() - 1; }
+    void recordUplink(int device, int sequenceNumber, double snir, double rssi) { append(device, sequenceNumber, snir, rssi, NAN); }
+    void recordMargin(int device, double margin) { append(device, -1, NAN, NAN, margin); }
+
+    /**
+     * Reads a file written by this class. devices receives the MAC address of
+     * each device index before f is called for the rows in recording order.
+     */
+    static void read(const char *fileName, std::vector<uint64_t>& devices, std::function<void (const Row&)> f);
+    /** Writes the rows of a file as CSV, one line per row with the MAC address of its device. */
+    static void exportCsv(const char *fileName, const char *csvFileName);
+};
+
+} // namespace flora
+
+#endif /* LORA_LORATELEMETRYSTORE_H_ */
@@ -25,22 +25,43 @@
 
 #include "inet/networklayer/common/L3Tools.h"
 #include "inet/networklayer/ipv4/Ipv4Header_m.h"
+#include "LoRaMac.h"
+#include <cctype>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
 
 namespace flora {
 
 Define_Module(NetworkServerApp);
 
+NetworkServerApp::~NetworkServerApp()
+{
+    cancelAndDelete(deduplicationTimer);
+}
 
 void NetworkServerApp::initialize(int stage)
 {
     if (stage == 0) {
         ASSERT(recvdPackets.size()==0);
         LoRa_ServerPacketReceived = registerSignal("LoRa_ServerPacketReceived");
+        LoRa_ServerPacketGateways = registerSignal("LoRa_ServerPacketGateways");
+        deduplicationWindow = par("deduplicationWindow");
+        deduplicationTick = par("deduplicationTick");
+        deduplicationTimer = new cMessage("deduplicationTimer");
         localPort = par("localPort");
         destPort = par("destPort");
         adrMethod = par("adrMethod").stdstringValue();
+        adrHistoryLength = par("adrHistoryLength");
+        sensitivityTable.parse(par("adrRequiredSNRTable").xmlValue());
+        if (par("recordTelemetry")) {
+            telemetryFileName = getTelemetryFileName();
+            telemetry.open(telemetryFileName.c_str(), par("telemetryBlockSize").intValue());
+        }
     } else if (stage == INITSTAGE_APPLICATION_LAYER) {
         startUDP();
+        initializeShard();
         getSimulation()->getSystemModule()->subscribe("LoRa_AppPacketSent", this);
         evaluateADRinServer = par("evaluateADRinServer");
         adrDeviceMargin = par("adrDeviceMargin");
@@ -55,6 +76,58 @@ void NetworkServerApp::initialize(int stage)
 }
 
 
+std::string NetworkServerApp::getTelemetryFileName() const
+{
+    std::string fileName = par("telemetryFile").stdstringValue();
+    if (!fileName.empty())
+        return fileName;
+    // next to the other result files, one per network server
+    cConfigurationEx *config = getEnvir()->getConfigEx();
+    std::string resultDir = config->getVariable(CFGVAR_RESULTDIR);
+#ifdef _WIN32
+    _mkdir(resultDir.c_str());
+#else
+    mkdir(resultDir.c_str(), 0777);
+#endif
+    std::string moduleName = getParentModule()->getFullName();
+    std::replace_if(moduleName.begin(), moduleName.end(), [] (char c) { return !isalnum(c); }, '_');
+    return resultDir + "/" + config->getVariable(CFGVAR_CONFIGNAME) + "-#" + config->getVariable(CFGVAR_RUNNUMBER) + "-" + moduleName + ".tlm";
+}
+
+void NetworkServerApp::initializeShard()
+{
+    const char *shardAddresses = par("shardAddresses");
+    std::vector<std::string> servers = cStringTokenizer(shardAddresses).asVector();
+    if (servers.empty())
+        return;
+    // the same ring as in PacketForwarder, unresolvable servers get no points
+    int numVirtualNodes = par("numVirtualNodes");
+    cModule *host = getContainingNode(this);
+    for (size_t i = 0; i < servers.size(); i++) {
+        L3Address address;
+        L3AddressResolver().tryResolve(servers[i].c_str(), address);
+        if (address.isUnspecified())
+            continue;
+        serverRing.addServer(servers[i], i, numVirtualNodes);
+        if (L3AddressResolver().findHostWithAddress(address) == host)
+            serverIndex = i;
+    }
+    serverRing.sort();
+    if (serverIndex == -1)
+        throw cRuntimeError("None of the shardAddresses '%s' resolves to this network server", shardAddresses);
+}
+
+bool NetworkServerApp::isShardDevice(cComponent *source)
+{
+    auto it = shardDevices.find(source->getId());
+    if (it == shardDevices.end()) {
+        cModule *node = getContainingNode(check_and_cast<cModule *>(source));
+        LoRaMac *mac = check_and_cast<LoRaMac *>(node->getSubmodule("LoRaNic")->getSubmodule("mac"));
+        it = shardDevices.emplace(source->getId(), serverRing.findServer(mac->getAddress()) == serverIndex).first;
+    }
+    return it->second;
+}
+
 void NetworkServerApp::startUDP()
 {
     socket.setOutputGate(gate("socketOut"));
@@ -78,8 +151,8 @@ void NetworkServerApp::handleMessage(cMessage *msg)
         updateKnownNodes(pkt);
         processLoraMACPacket(pkt);
     }
-    else if(msg->isSelfMessage()) {
-        processScheduledPacket(msg);
+    else if(msg == deduplicationTimer) {
+        expireDeduplicationWindows();
     }
 }
 
@@ -99,10 +172,6 @@ void NetworkServerApp::finish()
     recordScalar("LoRa_NS_DER", double(counterUniqueReceivedPackets)/counterOfSentPacketsFromNodes);
     for(uint i=0;i<knownNodes.size();i++)
     {
-        delete knownNodes[i].historyAllSNIR;
-        delete knownNodes[i].historyAllRSSI;
-        delete knownNodes[i].receivedSeqNumber;
-        delete knownNodes[i].calculatedSNRmargin;
         recordScalar("Send ADR for node", knownNodes[i].numberOfSentADRPackets);
     }
     for (std::map<int,int>::iterator it=numReceivedPerNode.begin(); it != numReceivedPerNode.end(); ++it)
@@ -111,21 +180,27 @@ void NetworkServerApp::finish()
         recordScalar(stringScalar.c_str(), it->second);
     }
 
+    if (telemetry.isOpen()) {
+        recordScalar("telemetry rows", telemetry.getNumRows());
+        telemetry.close();
+        if (par("exportTelemetryCsv")) {
+            std::string csvFileName = telemetryFileName;
+            size_t extension = csvFileName.rfind(".tlm");
+            if (extension != std::string::npos && extension == csvFileName.size() - 4)
+                csvFileName.erase(extension);
+            LoRaTelemetryStore::exportCsv(telemetryFileName.c_str(), (csvFileName + ".csv").c_str());
+        }
+    }
+
     receivedRSSI.recordAs("receivedRSSI");
     recordScalar("totalReceivedPackets", totalReceivedPackets);
 
-    while(!receivedPackets.empty()) {
-        receivedPackets.back().endOfWaiting->removeControlInfo();
-        delete receivedPackets.back().rcvdPacket;
-        if (receivedPackets.back().endOfWaiting && receivedPackets.back().endOfWaiting->isScheduled()) {
-            cancelAndDelete(receivedPackets.back().endOfWaiting);
-        }
-        else
-            delete receivedPackets.back().endOfWaiting;
-        receivedPackets.pop_back();
-    }
+    for (auto& it : receivedPackets)
+        delete it.second.rcvdPacket;
+    deduplicationQueue.clear();
 
     knownNodes.clear();
+    knownNodeIndices.clear();
     receivedPackets.clear();
 
     recordScalar("counterUniqueReceivedPacketsPerSF SF7", counterUniqueReceivedPacketsPerSF[0]);
@@ -165,130 +240,125 @@ void NetworkServerApp::finish()
         recordScalar("DER SF12", 0);
 }
 
+int NetworkServerApp::findKnownNode(const MacAddress& address) const
+{
+    auto it = knownNodeIndices.find(address.getInt());
+    return it != knownNodeIndices.end() ? it->second : -1;
+}
+
 bool NetworkServerApp::isPacketProcessed(const Ptr<const LoRaMacFrame> &pkt)
 {
-    for(const auto & elem : knownNodes) {
-        if(elem.srcAddr == pkt->getTransmitterAddress()) {
-            if(elem.lastSeqNoProcessed > pkt->getSequenceNumber()) return true;
-        }
-    }
-    return false;
+    int index = findKnownNode(pkt->getTransmitterAddress());
+    return index != -1 && knownNodes[index].lastSeqNoProcessed > pkt->getSequenceNumber();
 }
 
 void NetworkServerApp::updateKnownNodes(Packet* pkt)
 {
     const auto & frame = pkt->peekAtFront<LoRaMacFrame>();
-    bool nodeExist = false;
-    for(auto &elem : knownNodes)
+    int index = findKnownNode(frame->getTransmitterAddress());
+    if(index != -1)
     {
-        if(elem.srcAddr == frame->getTransmitterAddress()) {
-            nodeExist = true;
-            if(elem.lastSeqNoProcessed < frame->getSequenceNumber()) {
-                elem.lastSeqNoProcessed = frame->getSequenceNumber();
-            }
-            break;
+        auto &elem = knownNodes[index];
+        if(elem.lastSeqNoProcessed < frame->getSequenceNumber()) {
+            elem.lastSeqNoProcessed = frame->getSequenceNumber();
         }
     }
-
-    if(nodeExist == false)
+    else
     {
         knownNode newNode;
         newNode.srcAddr = frame->getTransmitterAddress();
         newNode.lastSeqNoProcessed = frame->getSequenceNumber();
         newNode.framesFromLastADRCommand = 0;
         newNode.numberOfSentADRPackets = 0;
+        if (evaluateADRinServer)
+            newNode.adrPolicy.reset(ILoRaAdrPolicy::create(adrMethod.c_str(), adrHistoryLength));
 
-        int nodeIndex = newNode.srcAddr.getInt() - 1;
+        int device = telemetry.addDevice(newNode.srcAddr.getInt());
+        ASSERT(device == (int)knownNodes.size());
+        // the first uplink of a node is recorded without sequence number
+        telemetry.recordUplink(device, -1, math::fraction2dB(frame->getSNIR()), frame->getRSSI());
 
-        newNode.historyAllSNIR = new cOutVector;
-        newNode.historyAllSNIR->setName(("Vector of SNIR for loRaNodes[" + std::to_string(nodeIndex) + "]").c_str());
-        newNode.historyAllSNIR->record(math::fraction2dB(frame->getSNIR()));
-
-        newNode.historyAllRSSI = new cOutVector;
-        newNode.historyAllRSSI->setName(("Vector of RSSI for loRaNodes[" + std::to_string(nodeIndex) + "]").c_str());
-        newNode.historyAllRSSI->record(frame->getRSSI());
-
-        newNode.receivedSeqNumber = new cOutVector;
-        newNode.receivedSeqNumber->setName(("Received Sequence number for Node " + std::to_string(nodeIndex)).c_str());
-
-        newNode.calculatedSNRmargin = new cOutVector;
-        newNode.calculatedSNRmargin->setName(("Calculated SNRmargin in ADR for Node " + std::to_string(nodeIndex)).c_str());
-
-        knownNodes.push_back(newNode);
+        knownNodeIndices[newNode.srcAddr.getInt()] = knownNodes.size();
+        knownNodes.push_back(std::move(newNode));
     }
 }
 
 void NetworkServerApp::addPktToProcessingTable(Packet* pkt)
 {
     const auto & frame = pkt->peekAtFront<LoRaMacFrame>();
-    bool packetExists = false;
-    for(auto &elem : receivedPackets)
+    auto it = receivedPackets.find(getReceivedPacketKey(frame));
+    if(it != receivedPackets.end())
     {
-        const auto &frameAux = elem.rcvdPacket->peekAtFront<LoRaMacFrame>();
-        if(frameAux->getTransmitterAddress() == frame->getTransmitterAddress() && frameAux->getSequenceNumber() == frame->getSequenceNumber())
-        {
-            packetExists = true;
-            const auto& networkHeader = getNetworkProtocolHeader(pkt);
-            const L3Address& gwAddress = networkHeader->getSourceAddress();
-            elem.possibleGateways.emplace_back(gwAddress, frame->getSNIR(), frame->getRSSI());
-            delete pkt;
-            break;
-        }
+        const auto& networkHeader = getNetworkProtocolHeader(pkt);
+        const L3Address& gwAddress = networkHeader->getSourceAddress();
+        it->second.possibleGateways.emplace_back(gwAddress, frame->getSNIR(), frame->getRSSI());
+        delete pkt;
     }
-    if(packetExists == false)
+    else
     {
         receivedPacket rcvPkt;
         rcvPkt.rcvdPacket = pkt;
-        rcvPkt.endOfWaiting = new cMessage("endOfWaitingWindow");
-        rcvPkt.endOfWaiting->setControlInfo(pkt);
         const auto& networkHeader = getNetworkProtocolHeader(pkt);
         const L3Address& gwAddress = networkHeader->getSourceAddress();
         rcvPkt.possibleGateways.emplace_back(gwAddress, frame->getSNIR(), frame->getRSSI());
         EV << "Added " << gwAddress << " " << frame->getSNIR() << " " << frame->getRSSI() << endl;
-        scheduleAt(simTime() + 1.2, rcvPkt.endOfWaiting);
-        receivedPackets.push_back(rcvPkt);
+        receivedPackets[getReceivedPacketKey(frame)] = rcvPkt;
+        simtime_t expiryTime = simTime() + deduplicationWindow;
+        if (deduplicationTick > 0) {
+            int64_t tick = deduplicationTick.raw();
+            expiryTime.setRaw((expiryTime.raw() + tick - 1) / tick * tick);
+        }
+        deduplicationQueue.emplace_back(expiryTime, getReceivedPacketKey(frame));
+        if (!deduplicationTimer->isScheduled())
+            scheduleAt(expiryTime, deduplicationTimer);
+    }
+}
+
+void NetworkServerApp::expireDeduplicationWindows()
+{
+    while (!deduplicationQueue.empty() && deduplicationQueue.front().first <= simTime()) {
+        ReceivedPacketKey key = deduplicationQueue.front().second;
+        deduplicationQueue.pop_front();
+        processScheduledPacket(key);
     }
+    if (!deduplicationQueue.empty())
+        scheduleAt(deduplicationQueue.front().first, deduplicationTimer);
 }
 
-void NetworkServerApp::processScheduledPacket(cMessage* selfMsg)
+void NetworkServerApp::processScheduledPacket(const ReceivedPacketKey& key)
 {
-    auto pkt = check_and_cast<Packet *>(selfMsg->removeControlInfo());
+    auto it = receivedPackets.find(key);
+    ASSERT(it != receivedPackets.end());
+    receivedPacket& elem = it->second;
+    Packet *pkt = elem.rcvdPacket;
     const auto & frame = pkt->peekAtFront<LoRaMacFrame>();
 
     if (simTime() >= getSimulation()->getWarmupPeriod())
     {
-        counterUniqueReceivedPacketsPerSF[frame->getLoRaSF()-7]++;
+        counterUniqueReceivedPacketsPerSF[frame->getPhy().getSpreadFactor()-7]++;
     }
     L3Address pickedGateway;
     double SNIRinGW = -99999999999;
     double RSSIinGW = -99999999999;
-    int packetNumber;
-    int nodeNumber;
-    for(uint i=0;i<receivedPackets.size();i++)
+    int nodeNumber = frame->getTransmitterAddress().getInt();
+    if (numReceivedPerNode.count(nodeNumber-1)>0)
     {
-        const auto &frameAux = receivedPackets[i].rcvdPacket->peekAtFront<LoRaMacFrame>();
-        if(frameAux->getTransmitterAddress() == frame->getTransmitterAddress() && frameAux->getSequenceNumber() == frame->getSequenceNumber())        {
-            packetNumber = i;
-            nodeNumber = frame->getTransmitterAddress().getInt();
-            if (numReceivedPerNode.count(nodeNumber-1)>0)
-            {
-                ++numReceivedPerNode[nodeNumber-1];
-            } else {
-                numReceivedPerNode[nodeNumber-1] = 1;
-            }
+        ++numReceivedPerNode[nodeNumber-1];
+    } else {
+        numReceivedPerNode[nodeNumber-1] = 1;
+    }
 
-            for(uint j=0;j<receivedPackets[i].possibleGateways.size();j++)
-            {
-                if(SNIRinGW < std::get<1>(receivedPackets[i].possibleGateways[j]))
-                {
-                    RSSIinGW = std::get<2>(receivedPackets[i].possibleGateways[j]);
-                    SNIRinGW = std::get<1>(receivedPackets[i].possibleGateways[j]);
-                    pickedGateway = std::get<0>(receivedPackets[i].possibleGateways[j]);
-                }
-            }
+    for(uint j=0;j<elem.possibleGateways.size();j++)
+    {
+        if(SNIRinGW < std::get<1>(elem.possibleGateways[j]))
+        {
+            RSSIinGW = std::get<2>(elem.possibleGateways[j]);
+            SNIRinGW = std::get<1>(elem.possibleGateways[j]);
+            pickedGateway = std::get<0>(elem.possibleGateways[j]);
         }
     }
     emit(LoRa_ServerPacketReceived, true);
+    emit(LoRa_ServerPacketGateways, (long)elem.possibleGateways.size());
     if (simTime() >= getSimulation()->getWarmupPeriod())
     {
         counterUniqueReceivedPackets++;
@@ -298,9 +368,8 @@ void NetworkServerApp::processScheduledPacket(cMessage* selfMsg)
     {
         evaluateADR(pkt, pickedGateway, SNIRinGW, RSSIinGW);
     }
-    delete receivedPackets[packetNumber].rcvdPacket;
-    delete selfMsg;
-    receivedPackets.erase(receivedPackets.begin()+packetNumber);
+    delete pkt;
+    receivedPackets.erase(it);
 }
 
 void NetworkServerApp::evaluateADR(Packet* pkt, L3Address pickedGateway, double SNIRinGW, double RSSIinGW)
@@ -320,41 +389,22 @@ void NetworkServerApp::evaluateADR(Packet* pkt, L3Address pickedGateway, double
         sendADRAckRep = true;
     }
 
-    for(uint i=0;i<knownNodes.size();i++)
+    int i = findKnownNode(frame->getTransmitterAddress());
+    if(i != -1)
     {
-        if(knownNodes[i].srcAddr == frame->getTransmitterAddress())
-        {
-            knownNodes[i].adrListSNIR.push_back(SNIRinGW);
-            knownNodes[i].historyAllSNIR->record(SNIRinGW);
-            knownNodes[i].historyAllRSSI->record(RSSIinGW);
-            knownNodes[i].receivedSeqNumber->record(frame->getSequenceNumber());
-            if(knownNodes[i].adrListSNIR.size() == 20) knownNodes[i].adrListSNIR.pop_front();
-            knownNodes[i].framesFromLastADRCommand++;
-
-            if(knownNodes[i].framesFromLastADRCommand == 20 || sendADRAckRep == true)
-            {
-                nodeIndex = i;
-                knownNodes[i].framesFromLastADRCommand = 0;
-                sendADR = true;
-                if(adrMethod == "max")
-                {
-                    SNRm = *max_element(knownNodes[i].adrListSNIR.begin(), knownNodes[i].adrListSNIR.end());
-                }
-                if(adrMethod == "avg")
-                {
-                    double totalSNR = 0;
-                    int numberOfFields = 0;
-                    for (std::list<double>::iterator it=knownNodes[i].adrListSNIR.begin(); it != knownNodes[i].adrListSNIR.end(); ++it)
-                    {
-                        totalSNR+=*it;
-                        numberOfFields++;
-                    }
-                    SNRm = totalSNR/numberOfFields;
-                }
+        knownNodes[i].adrPolicy->addSNIR(SNIRinGW);
+        telemetry.recordUplink(i, frame->getSequenceNumber(), SNIRinGW, RSSIinGW);
+        knownNodes[i].framesFromLastADRCommand++;
 
-            }
+        if(knownNodes[i].framesFromLastADRCommand == 20 || sendADRAckRep == true)
+        {
+            nodeIndex = i;
+            knownNodes[i].framesFromLastADRCommand = 0;
+            sendADR = true;
+            SNRm = knownNodes[i].adrPolicy->getSNR();
 
         }
+
     }
 
     if(sendADR || sendADRAckRep)
@@ -365,21 +415,15 @@ void NetworkServerApp::evaluateADR(Packet* pkt, L3Address pickedGateway, double
         if(sendADR)
         {
             double SNRmargin;
-            double requiredSNR;
-            if(frame->getLoRaSF() == 7) requiredSNR = -7.5;
-            if(frame->getLoRaSF() == 8) requiredSNR = -10;
-            if(frame->getLoRaSF() == 9) requiredSNR = -12.5;
-            if(frame->getLoRaSF() == 10) requiredSNR = -15;
-            if(frame->getLoRaSF() == 11) requiredSNR = -17.5;
-            if(frame->getLoRaSF() == 12) requiredSNR = -20;
+            double requiredSNR = sensitivityTable.getRequiredSNR(frame->getPhy().getSpreadFactor());
 
             SNRmargin = SNRm - requiredSNR - adrDeviceMargin;
-            knownNodes[nodeIndex].calculatedSNRmargin->record(SNRmargin);
+            telemetry.recordMargin(nodeIndex, SNRmargin);
             int Nstep = round(SNRmargin/3);
             LoRaOptions newOptions;
 
             // Increase the data rate with each step
-            int calculatedSF = frame->getLoRaSF();
+            int calculatedSF = frame->getPhy().getSpreadFactor();
             while(Nstep > 0 && calculatedSF > 7)
             {
                 calculatedSF--;
@@ -387,7 +431,7 @@ void NetworkServerApp::evaluateADR(Packet* pkt, L3Address pickedGateway, double
             }
 
             // Decrease the Tx power by 3 for each step, until min reached
-            double calculatedPowerdBm = math::mW2dBmW(frame->getLoRaTP()) + 30;
+            double calculatedPowerdBm = math::mW2dBmW(frame->getPhy().getPower().get()) + 30;
             while(Nstep > 0 && calculatedPowerdBm > 2)
             {
                 calculatedPowerdBm-=3;
@@ -422,12 +466,10 @@ void NetworkServerApp::evaluateADR(Packet* pkt, L3Address pickedGateway, double
 
         //frameToSend->encapsulate(mgmtPacket);
         frameToSend->setReceiverAddress(frame->getTransmitterAddress());
+        LoRaPhyParameters downlinkPhy = frame->getPhy();
         //FIXME: What value to set for LoRa TP
-        //frameToSend->setLoRaTP(pkt->getLoRaTP());
-        frameToSend->setLoRaTP(math::dBmW2mW(14));
-        frameToSend->setLoRaCF(frame->getLoRaCF());
-        frameToSend->setLoRaSF(frame->getLoRaSF());
-        frameToSend->setLoRaBW(frame->getLoRaBW());
+        downlinkPhy.setPower(mW(math::dBmW2mW(14)));
+        frameToSend->setPhy(downlinkPhy);
 
         auto pktAux = new Packet("ADRPacket");
         mgmtPacket->setChunkLength(B(par("headerLength").intValue()));
@@ -442,6 +484,9 @@ void NetworkServerApp::evaluateADR(Packet* pkt, L3Address pickedGateway, double
 
 void NetworkServerApp::receiveSignal(cComponent *source, simsignal_t signalID, intval_t value, cObject *details)
 {
+    // with sharding the DER is relative to the devices of this server
+    if (serverIndex != -1 && !isShardDevice(source))
+        return;
     if (simTime() >= getSimulation()->getWarmupPeriod())
     {
         counterOfSentPacketsFromNodes++;
@@ -28,7 +28,14 @@
 #include "inet/applications/base/ApplicationBase.h"
 #include "inet/transportlayer/contract/udp/UdpSocket.h"
 #include "../LoRaApp/LoRaAppPacket_m.h"
+#include "LoRaPhy/LoRaSensitivityTable.h"
+#include "LoRaAdrPolicy.h"
+#include "LoRaServerRing.h"
+#include "LoRaTelemetryStore.h"
+#include <deque>
 #include <list>
+#include <memory>
+#include <unordered_map>
 
 namespace flora {
 
@@ -39,11 +46,7 @@ public:
     int framesFromLastADRCommand;
     int lastSeqNoProcessed;
     int numberOfSentADRPackets;
-    std::list<double> adrListSNIR;
-    cOutVector *historyAllSNIR;
-    cOutVector *historyAllRSSI;
-    cOutVector *receivedSeqNumber;
-    cOutVector *calculatedSNRmargin;
+    std::unique_ptr<ILoRaAdrPolicy> adrPolicy; // only with evaluateADRinServer
 };
 
 class knownGW
@@ -56,16 +59,37 @@ class receivedPacket
 {
 public:
     Packet* rcvdPacket = nullptr;
-    cMessage* endOfWaiting = nullptr;
     std::vector<std::tuple<L3Address, double, double>> possibleGateways; // <address, sinr, rssi>
 };
 
 class NetworkServerApp : public cSimpleModule, cListener
 {
+  protected:
+    /** Uplinks heard by several gateways share one entry. */
+    struct ReceivedPacketKey {
+        uint64_t transmitterAddress;
+        int sequenceNumber;
+        bool operator==(const ReceivedPacketKey& other) const { return transmitterAddress == other.transmitterAddress && sequenceNumber == other.sequenceNumber; }
+    };
+    struct ReceivedPacketKeyHash {
+        size_t operator()(const ReceivedPacketKey& key) const { return std::hash<uint64_t>()(key.transmitterAddress * 31 + (uint32_t)key.sequenceNumber); }
+    };
+
   protected:
     std::vector<knownNode> knownNodes;
+    /** Index of the node in knownNodes by its MAC address. */
+    std::unordered_map<uint64_t, int> knownNodeIndices;
     std::vector<knownGW> knownGateways;
-    std::vector<receivedPacket> receivedPackets;
+    /** Uplinks waiting for the end of the gateway collection window. */
+    std::unordered_map<ReceivedPacketKey, receivedPacket, ReceivedPacketKeyHash> receivedPackets;
+    /**
+     * End of the deduplication window of the pending uplinks. The window has
+     * a fixed length, so the queue is in time order and one timer serves it.
+     */
+    std::deque<std::pair<simtime_t, ReceivedPacketKey>> deduplicationQueue;
+    cMessage *deduplicationTimer = nullptr;
+    simtime_t deduplicationWindow;
+    simtime_t deduplicationTick;
     int localPort = -1, destPort = -1;
     std::vector<std::tuple<MacAddress, int>> recvdPackets;
     // state
@@ -73,8 +97,21 @@ class NetworkServerApp : public cSimpleModule, cListener
     cMessage *selfMsg = nullptr;
     int totalReceivedPackets;
     std::string adrMethod;
+    int adrHistoryLength;
     double adrDeviceMargin;
+    LoRaSensitivityTable sensitivityTable;
     std::map<int, int> numReceivedPerNode;
+    /** SNIR, RSSI, sequence number and SNR margin series of the known nodes, by knownNodes index. */
+    LoRaTelemetryStore telemetry;
+    std::string telemetryFileName;
+
+    /** @name Shard of this server if the packet forwarders shard uplinks over several servers */
+    //@{
+    LoRaServerRing serverRing;
+    int serverIndex = -1; // -1 if not sharded
+    /** Whether the device of a LoRa_AppPacketSent source is in this server's shard, by module id. */
+    std::unordered_map<int, bool> shardDevices;
+    //@}
 
   protected:
     virtual void initialize(int stage) override;
@@ -83,18 +120,27 @@ class NetworkServerApp : public cSimpleModule, cListener
     void processLoraMACPacket(Packet *pk);
     void startUDP();
     void setSocketOptions();
+    std::string getTelemetryFileName() const;
+    void initializeShard();
+    bool isShardDevice(cComponent *source);
     virtual int numInitStages() const override { return NUM_INIT_STAGES; }
+    static ReceivedPacketKey getReceivedPacketKey(const Ptr<const LoRaMacFrame>& frame) { return {frame->getTransmitterAddress().getInt(), frame->getSequenceNumber()}; }
+    /** Returns -1 for unknown nodes. */
+    int findKnownNode(const MacAddress& address) const;
     bool isPacketProcessed(const Ptr<const LoRaMacFrame> &);
     void updateKnownNodes(Packet* pkt);
     void addPktToProcessingTable(Packet* pkt);
-    void processScheduledPacket(cMessage* selfMsg);
+    void expireDeduplicationWindows();
+    void processScheduledPacket(const ReceivedPacketKey& key);
     void evaluateADR(Packet *pkt, L3Address pickedGateway, double SNIRinGW, double RSSIinGW);
     void receiveSignal(cComponent *source, simsignal_t signalID, intval_t value, cObject *details) override;
     bool evaluateADRinServer;
 
     cHistogram receivedRSSI;
   public:
+    virtual ~NetworkServerApp();
     simsignal_t LoRa_ServerPacketReceived;
+    simsignal_t LoRa_ServerPacketGateways;
     int counterOfSentPacketsFromNodes = 0;
     int counterOfSentPacketsFromNodesPerSF[6];
     int counterUniqueReceivedPackets = 0;
@@ -35,6 +35,7 @@ void PacketForwarder::initialize(int stage)
         LoRa_PacketReceivedPerNode = registerSignal("LoRa_PacketReceivedPerNode");
         localPort = par("localPort");
         destPort = par("destPort");
+        recordNodeStatistics = par("recordNodeStatistics");
     } else if (stage == INITSTAGE_APPLICATION_LAYER) {
         startUDP();
         getSimulation()->getSystemModule()->subscribe("LoRa_AppPacketSent", this);
@@ -57,38 +58,39 @@ void PacketForwarder::updateNodeStatistics(const MacAddress& nodeAddr, simtime_t
 
 void PacketForwarder::startUDP()
 {
-    EV << "Wywalamy sie tutaj" << endl;
     socket.setOutputGate(gate("socketOut"));
     const char *localAddress = par("localAddress");
     socket.bind(*localAddress ? L3AddressResolver().resolve(localAddress) : L3Address(), localPort);
-    EV << "Dojechalismy za pierwszy resolv" << endl;
+    EV_DEBUG << "Bound the UDP socket to port " << localPort << endl;
     // TODO: is this required?
     //setSocketOptions();
 
     const char *destAddrs = par("destAddresses");
     cStringTokenizer tokenizer(destAddrs);
     const char *token;
+    int numVirtualNodes = par("numVirtualNodes");
 
     // Create UDP sockets to multiple destination addresses (network servers)
     while ((token = tokenizer.nextToken()) != nullptr) {
-        EV << "Wchodze w petle" << endl;
-        EV << token << endl;
         L3Address result;
         L3AddressResolver().tryResolve(token, result);
-        EV << "Wychodze z petli" << endl;
         if (result.isUnspecified())
             EV_ERROR << "cannot resolve destination address: " << token << endl;
         else
             EV << "Got destination address: " << token << endl;
+        // the ring points are derived from the configured name, not from the
+        // assigned address, so they stay put when other servers come or go
+        if (!result.isUnspecified())
+            serverRing.addServer(token, destAddresses.size(), numVirtualNodes);
         destAddresses.push_back(result);
     }
-    EV << "Dojechalismy do konca" << endl;
+    serverRing.sort();
+    forwardedPacketCounts.assign(destAddresses.size(), 0);
 }
 
-
 void PacketForwarder::handleMessage(cMessage *msg)
 {
-    EV << msg->getArrivalGate() << endl;
+    EV_DEBUG << msg->getArrivalGate() << endl;
     if (msg->arrivedOn("lowerLayerIn")) {
         EV << "Received LoRaMAC frame" << endl;
         auto pkt = check_and_cast<Packet*>(msg);
@@ -130,7 +132,8 @@ void PacketForwarder::processLoraMACPacket(Packet *pk)
     auto frame = pk->removeAtFront<LoRaMacFrame>();
 
     // Update statistics for this node
-    updateNodeStatistics(frame->getTransmitterAddress(), simTime());
+    if (recordNodeStatistics)
+        updateNodeStatistics(frame->getTransmitterAddress(), simTime());
 
     auto snirInd = pk->getTag<SnirInd>();
 
@@ -146,12 +149,16 @@ void PacketForwarder::processLoraMACPacket(Packet *pk)
     EV << frame->getTransmitterAddress() << endl;
     //for (std::vector<nodeEntry>::iterator it = knownNodes.begin() ; it != knownNodes.end(); ++it)
 
-    // FIXME : Identify network server message is destined for.
-    L3Address destAddr = destAddresses[0];
+    int serverIndex = serverRing.findServer(frame->getTransmitterAddress());
+    if (serverIndex == -1) {
+        delete pk;
+        return;
+    }
+    forwardedPacketCounts[serverIndex]++;
     if (pk->getControlInfo())
        delete pk->removeControlInfo();
 
-    socket.sendTo(pk, destAddr, destPort);
+    socket.sendTo(pk, destAddresses[serverIndex], destPort);
 }
 
 void PacketForwarder::sendPacket()
@@ -183,6 +190,10 @@ void PacketForwarder::finish()
 {
     recordScalar("LoRa_GW_DER", double(counterOfReceivedPackets)/counterOfSentPacketsFromNodes);
 
+    if (destAddresses.size() > 1)
+        for (size_t i = 0; i < destAddresses.size(); i++)
+            recordScalar(("Packets_Forwarded_Server_" + destAddresses[i].str()).c_str(), forwardedPacketCounts[i]);
+
     // Record per-node statistics
     for (const auto& nodeStat : nodeStatistics) {
         std::string nodeAddr = nodeStat.first.str();
@@ -23,6 +23,7 @@
 
 #include "LoRaMacControlInfo_m.h"
 #include "LoRaMacFrame_m.h"
+#include "LoRaServerRing.h"
 #include "inet/applications/base/ApplicationBase.h"
 #include "inet/transportlayer/contract/udp/UdpSocket.h"
 
@@ -43,12 +44,16 @@ class PacketForwarder : public cSimpleModule, public cListener
 {
   protected:
     std::vector<L3Address> destAddresses;
+    /** The resolved network servers by index into destAddresses. */
+    LoRaServerRing serverRing;
+    std::vector<long> forwardedPacketCounts; // per destination
     int localPort = -1, destPort = -1;
     // state
     UdpSocket socket;
     cMessage *selfMsg = nullptr;
 
     // Node tracking
+    bool recordNodeStatistics = false;
     std::map<MacAddress, NodeStats> nodeStatistics;
 
   protected:
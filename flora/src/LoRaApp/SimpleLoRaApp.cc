@@ -38,6 +38,22 @@ void SimpleLoRaApp::initialize(int stage)
         }
         forest = new ForestEnvironment();
         sensor = new SensorSimulator();
+
+        //LoRa physical layer parameters, before the radio registers with the medium
+        //at INITSTAGE_PHYSICAL_LAYER under its center frequency
+        loRaRadio = check_and_cast<LoRaRadio *>(getParentModule()->getSubmodule("LoRaNic")->getSubmodule("radio"));
+        loRaRadio->loRaTP = par("initialLoRaTP").doubleValue();
+//        setTP(par("initialLoRaTP").doubleValue());
+//        loRaCF = units::values::Hz(par("initialLoRaCF").doubleValue());
+        loRaRadio->loRaCF = units::values::Hz(par("initialLoRaCF").doubleValue());
+//        loRaSF = par("initialLoRaSF");
+        loRaRadio->loRaSF = par("initialLoRaSF");
+//        loRaBW = inet::units::values::Hz(par("initialLoRaBW").doubleValue());
+        loRaRadio->loRaBW = inet::units::values::Hz(par("initialLoRaBW").doubleValue());
+//        loRaCR = par("initialLoRaCR");
+        loRaRadio->loRaCR = par("initialLoRaCR");
+//        loRaUseHeader = par("initialUseHeader");
+        loRaRadio->loRaUseHeader = par("initialUseHeader");
     }
     else if (stage == INITSTAGE_APPLICATION_LAYER) {
         bool isOperational;
@@ -47,7 +63,7 @@ void SimpleLoRaApp::initialize(int stage)
             throw cRuntimeError("This module doesn't support starting in node DOWN state");
         do {
             timeToFirstPacket = par("timeToFirstPacket");
-            EV << "Wylosowalem czas :" << timeToFirstPacket << endl;
+            EV << "Time to first packet: " << timeToFirstPacket << endl;
             //if(timeToNextPacket < 5) error("Time to next packet must be grater than 3");
         } while(timeToFirstPacket <= 5);
 
@@ -70,21 +86,11 @@ void SimpleLoRaApp::initialize(int stage)
         tempErrorSignal = registerSignal("temperatureError");
         humErrorSignal = registerSignal("humidityError");
 
-        //LoRa physical layer parameters
-        loRaRadio = check_and_cast<LoRaRadio *>(getParentModule()->getSubmodule("LoRaNic")->getSubmodule("radio"));
-        loRaRadio->loRaTP = par("initialLoRaTP").doubleValue();
-//        setTP(par("initialLoRaTP").doubleValue());
-//        loRaCF = units::values::Hz(par("initialLoRaCF").doubleValue());
-        loRaRadio->loRaCF = units::values::Hz(par("initialLoRaCF").doubleValue());
-//        loRaSF = par("initialLoRaSF");
-        loRaRadio->loRaSF = par("initialLoRaSF");
-//        loRaBW = inet::units::values::Hz(par("initialLoRaBW").doubleValue());
-        loRaRadio->loRaBW = inet::units::values::Hz(par("initialLoRaBW").doubleValue());
-//        loRaCR = par("initialLoRaCR");
-        loRaRadio->loRaCR = par("initialLoRaCR");
-//        loRaUseHeader = par("initialUseHeader");
-        loRaRadio->loRaUseHeader = par("initialUseHeader");
         evaluateADRinNode = par("evaluateADRinNode");
+        dutyCycle = par("dutyCycle");
+        //LoRaMac inherits headerLength from CsmaCaMac, in bits
+        cModule *mac = getParentModule()->getSubmodule("LoRaNic")->getSubmodule("mac");
+        frameLength = B(par("dataSize").intValue()) + B(b(mac->par("headerLength").intValue()));
 
         sfVector.setName("SF Vector");
         tpVector.setName("TP Vector");
@@ -170,14 +176,8 @@ void SimpleLoRaApp::handleMessage(cMessage *msg)
             delete msg;
             if(numberOfPacketsToSend == 0 || sentPackets < numberOfPacketsToSend)
             {
-                double time;
-                int loRaSF = getSF();
-                if(loRaSF == 7) time = 7.808;
-                if(loRaSF == 8) time = 13.9776;
-                if(loRaSF == 9) time = 24.6784;
-                if(loRaSF == 10) time = 49.3568;
-                if(loRaSF == 11) time = 85.6064;
-                if(loRaSF == 12) time = 171.2128;
+                const LoRaAirtime airtime = computeLoRaAirtime(getSF(), getBW(), getCR(), frameLength.get(), loRaRadio->loRaUseHeader);
+                simtime_t time = airtime.getDuration() / dutyCycle;
                 do {
                     timeToNextPacket = par("timeToNextPacket");
                     //if(timeToNextPacket < 3) error("Time to next packet must be grater than 3");
@@ -283,12 +283,13 @@ void SimpleLoRaApp::sendJoinRequest()
     }
 
 
-    auto loraTag = pktRequest->addTagIfAbsent<LoRaTag>();
-    loraTag->setBandwidth(getBW());
-    loraTag->setCenterFrequency(getCF());
-    loraTag->setSpreadFactor(getSF());
-    loraTag->setCodeRendundance(getCR());
-    loraTag->setPower(mW(math::dBmW2mW(getTP())));
+    auto& phy = pktRequest->addTagIfAbsent<LoRaTag>()->getPhyForUpdate();
+    phy.setBandwidth(getBW());
+    phy.setCenterFrequency(getCF());
+    phy.setSpreadFactor(getSF());
+    phy.setCodeRendundance(getCR());
+    phy.setUseHeader(loRaRadio->loRaUseHeader);
+    phy.setPower(mW(math::dBmW2mW(getTP())));
 
     //add LoRa control info
   /*  LoRaMacControlInfo *cInfo = new LoRaMacControlInfo();
@@ -316,8 +317,8 @@ void SimpleLoRaApp::sendJoinRequest()
     temperatureHistogram.collect(measuredTemp);
     humidityHistogram.collect(measuredHum);
 
-    EV << "Sending pecket with TP: " << getTP() << endl;
-    EV << "Wysylam pakiet with SF: " << getSF() << endl;
+    EV << "Sending packet with TP: " << getTP() << endl;
+    EV_DEBUG << "Sending packet with SF: " << getSF() << endl;
     EV << "Sending packet with Temperature: " << measuredTemp << "°C, Humidity: " << measuredHum << "%" << endl;
 
     EV << "Forest Environment Status:" << endl
@@ -382,7 +383,7 @@ double SimpleLoRaApp::getTP() {
 }
 
 void SimpleLoRaApp::setCF(units::values::Hz CF) {
-    loRaRadio->loRaCF = CF;
+    loRaRadio->setLoRaCF(CF);
 }
 
 units::values::Hz SimpleLoRaApp::getCF() {
@@ -25,6 +25,7 @@
 #include "LoRaAppPacket_m.h"
 #include "LoRa/LoRaMacControlInfo_m.h"
 #include "LoRa/LoRaRadio.h"
+#include "LoRaPhy/LoRaAirtime.h"
 #include "ForestEnvironment.h"
 #include "SensorSimulator.h"
 
@@ -59,6 +60,8 @@ class SimpleLoRaApp : public cSimpleModule, public ILifecycle
         int lastSentMeasurement;
         simtime_t timeToFirstPacket;
         simtime_t timeToNextPacket;
+        double dutyCycle;
+        B frameLength;
         double currentTemperature;
         double currentHumidity;
 
@@ -56,6 +56,7 @@ void LoRaEnergyConsumer::initialize(int stage)
         //radioModule->subscribe(EpEnergyStorageBase::residualEnergyCapacityChangedSignal, this);
         //radioModule->subscribe(IdealEpEnergyStorage::residualEnergyCapacityChangedSignal, this);
         radio = check_and_cast<IRadio *>(radioModule);
+        loRaRadio = check_and_cast<LoRaRadio *>(radioModule);
 
         energySource.reference(this, "energySourceModule", true);
 
@@ -227,8 +228,7 @@ W LoRaEnergyConsumer::getPowerConsumption() const
             powerConsumption += mW(supplyVoltage * idleSupplyCurrent);
         }
     } else if (radioMode == IRadio::RADIO_MODE_TRANSMITTER) {
-        LoRaRadio *radio = check_and_cast<LoRaRadio *>(getParentModule());
-        auto current = transmitterTransmittingSupplyCurrent.find(radio->loRaTP);
+        auto current = transmitterTransmittingSupplyCurrent.find(loRaRadio->loRaTP);
         powerConsumption += mW(supplyVoltage * current->second);
     } else {
         powerConsumption += mW(supplyVoltage * idleSupplyCurrent);
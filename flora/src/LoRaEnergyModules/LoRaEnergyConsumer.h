@@ -20,6 +20,7 @@
 #include "inet/power/storage/IdealEpEnergyStorage.h"
 #include <map>
 #include "inet/common/ModuleAccess.h"
+#include "LoRa/LoRaRadio.h"
 
 using namespace inet;
 
@@ -54,6 +55,7 @@ protected:
     double supplyVoltage;
     // map between txPower (dBm) and supply current (mA)
     std::map<double, double> transmitterTransmittingSupplyCurrent;
+    LoRaRadio *loRaRadio = nullptr;
 
     // Deklarasi sinyal vektor
     simsignal_t stateChangeSignal;
@@ -0,0 +1,60 @@
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see http://www.gnu.org/licenses/.
+//
+
+#ifndef LORAPHY_ILORASHADOWINGPATHLOSS_H_
+#define LORAPHY_ILORASHADOWINGPATHLOSS_H_
+
+#include "inet/common/Units.h"
+
+using namespace inet;
+using namespace inet::units::values;
+namespace flora {
+
+/**
+ * Path loss models whose loss is a deterministic mean plus a random
+ * log-normal shadowing term. Splitting the two lets the analog model cache
+ * the mean per link and draw only the shadowing per reception.
+ */
+class ILoRaShadowingPathLoss
+{
+  public:
+    virtual ~ILoRaShadowingPathLoss() {}
+
+    /**
+     * Returns the path loss without the shadowing term as a fraction.
+     */
+    virtual double computeMeanPathLoss(mps propagationSpeed, Hz frequency, m distance) const = 0;
+
+    /**
+     * True if the per-link samples below are keyed on (transmission id,
+     * receiver id) and thus independent of the order they are drawn in.
+     * Otherwise they are drawn from the module's RNG.
+     */
+    virtual bool isCounterBasedShadowing() const = 0;
+
+    /**
+     * Shadowing sample in dB for the given transmission at the given receiver.
+     */
+    virtual double computeShadowing(int transmissionId, int receiverId) const = 0;
+
+    /**
+     * Shadowing samples in dB for one transmission at count receivers.
+     */
+    virtual void computeShadowing(int transmissionId, const int *receiverIds, double *shadowing, int count) const = 0;
+};
+
+} // namespace inet
+
+#endif /* LORAPHY_ILORASHADOWINGPATHLOSS_H_ */
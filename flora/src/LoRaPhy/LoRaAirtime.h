@@ -0,0 +1,106 @@
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see http://www.gnu.org/licenses/.
+//
+
+#ifndef LORAPHY_LORAAIRTIME_H_
+#define LORAPHY_LORAAIRTIME_H_
+
+#include "LoRaSensitivityTable.h"
+
+namespace flora {
+
+constexpr int LORA_PREAMBLE_SYMBOLS = 8;
+constexpr int LORA_HEADER_SYMBOLS = 8;
+constexpr int LORA_MAX_PAYLOAD_BYTES = 255;
+//LoRaWAN requires the low data rate optimization above 16 ms symbol time
+constexpr double LORA_LOW_DATA_RATE_SYMBOL_TIME = 0.016;
+
+struct LoRaSymbolTimeTable
+{
+    double seconds[LORA_NUM_SF][LORA_NUM_BW];
+};
+
+constexpr LoRaSymbolTimeTable makeLoRaSymbolTimeTable()
+{
+    LoRaSymbolTimeTable table = {};
+    for (int i = 0; i < LORA_NUM_SF; i++)
+        for (int j = 0; j < LORA_NUM_BW; j++)
+            table.seconds[i][j] = (1 << (LORA_MIN_SF + i)) / LORA_BANDWIDTHS[j];
+    return table;
+}
+
+//symbol duration 2^SF / BW, rows are SF6 ... SF12, columns as in LORA_BANDWIDTHS
+constexpr LoRaSymbolTimeTable LORA_SYMBOL_TIMES = makeLoRaSymbolTimeTable();
+
+constexpr bool isLoRaLowDataRateOptimized(int sf, int bandwidthIndex)
+{
+    return LORA_SYMBOL_TIMES.seconds[sf - LORA_MIN_SF][bandwidthIndex] >= LORA_LOW_DATA_RATE_SYMBOL_TIME;
+}
+
+/**
+ * Number of symbols after the preamble (header included) according to the
+ * Semtech SX1272 datasheet, section 4.1.1.7, with CRC enabled. The coding
+ * rate is 4/(cr+4).
+ */
+constexpr int computeLoRaPayloadSymbols(int sf, int cr, int payloadBytes, bool explicitHeader, bool lowDataRateOptimized)
+{
+    int numerator = 8 * payloadBytes - 4 * sf + 28 + 16 - (explicitHeader ? 0 : 20);
+    int denominator = 4 * (sf - (lowDataRateOptimized ? 2 : 0));
+    int blocks = numerator > 0 ? (numerator + denominator - 1) / denominator : 0;
+    return LORA_HEADER_SYMBOLS + blocks * (cr + 4);
+}
+
+static_assert(computeLoRaPayloadSymbols(7, 1, 20, true, false) == 43, "SF7 4/5 20B payload");
+static_assert(computeLoRaPayloadSymbols(12, 1, 20, true, true) == 28, "SF12 4/5 20B payload with DE");
+
+/**
+ * On-air duration of a LoRa frame split into preamble, header (the first
+ * eight symbols after the preamble) and the rest of the payload.
+ */
+struct LoRaAirtime
+{
+    simtime_t preamble;
+    simtime_t header;
+    simtime_t payload;
+
+    simtime_t getDuration() const { return preamble + header + payload; }
+};
+
+inline LoRaAirtime computeLoRaAirtime(int sf, Hz bandwidth, int cr, int payloadBytes, bool explicitHeader, bool lowDataRateOptimized)
+{
+    int bandwidthIndex = LoRaSensitivityTable::getBandwidthIndex(bandwidth);
+    if (sf < LORA_MIN_SF || sf > LORA_MAX_SF || bandwidthIndex < 0)
+        throw cRuntimeError("No LoRa symbol time for SF %d and bandwidth %g Hz", sf, bandwidth.get());
+    if (payloadBytes < 0 || payloadBytes > LORA_MAX_PAYLOAD_BYTES)
+        throw cRuntimeError("Invalid LoRa payload length %d bytes", payloadBytes);
+    double symbolTime = LORA_SYMBOL_TIMES.seconds[sf - LORA_MIN_SF][bandwidthIndex];
+    int payloadSymbols = computeLoRaPayloadSymbols(sf, cr, payloadBytes, explicitHeader, lowDataRateOptimized);
+    LoRaAirtime airtime;
+    airtime.preamble = (LORA_PREAMBLE_SYMBOLS + 4.25) * symbolTime;
+    airtime.header = LORA_HEADER_SYMBOLS * symbolTime;
+    airtime.payload = (payloadSymbols - LORA_HEADER_SYMBOLS) * symbolTime;
+    return airtime;
+}
+
+/** As above, with the low data rate optimization enabled as LoRaWAN mandates. */
+inline LoRaAirtime computeLoRaAirtime(int sf, Hz bandwidth, int cr, int payloadBytes, bool explicitHeader)
+{
+    int bandwidthIndex = LoRaSensitivityTable::getBandwidthIndex(bandwidth);
+    bool lowDataRateOptimized = bandwidthIndex >= 0 && sf >= LORA_MIN_SF && sf <= LORA_MAX_SF && isLoRaLowDataRateOptimized(sf, bandwidthIndex);
+    return computeLoRaAirtime(sf, bandwidth, cr, payloadBytes, explicitHeader, lowDataRateOptimized);
+}
+
+} // namespace flora
+
+#endif /* LORAPHY_LORAAIRTIME_H_ */
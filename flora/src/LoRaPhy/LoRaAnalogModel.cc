@@ -20,70 +20,145 @@
 #include "LoRaReception.h"
 #include "LoRaTransmission.h"
 #include "LoRaReceiver.h"
+#include "LoRaMedium.h"
 #include "LoRa/LoRaRadio.h"
+#include "inet/physicallayer/wireless/common/base/packetlevel/NarrowbandTransmitterBase.h"
 
 namespace flora {
 
 Define_Module(LoRaAnalogModel);
 
-std::ostream& LoRaAnalogModel::printToStream(std::ostream& stream, int level, int evFlags) const
+void LoRaAnalogModel::initialize(int stage)
 {
-    return stream << "LoRaAnalogModel";
+    ScalarAnalogModelBase::initialize(stage);
+    if (stage == INITSTAGE_LOCAL) {
+        useLinkBudgetCache = par("useLinkBudgetCache");
+        linkBudgetMinPower = par("linkBudgetMinPower");
+        linkBudgetMaxTransmissionPower = par("linkBudgetMaxTransmissionPower");
+        linkBudgetMargin = par("linkBudgetMargin");
+        noiseFloorTable.parse(par("noiseFloorTable").xmlValue());
+    }
+    else if (stage == INITSTAGE_PHYSICAL_LAYER_NEIGHBOR_CACHE) {
+        const IRadioMedium *radioMedium = check_and_cast<const IRadioMedium *>(getParentModule());
+        const IPathLoss *pathLoss = radioMedium->getPathLoss();
+        terrainPathLoss = dynamic_cast<const LoRaTerrainPathLoss *>(pathLoss);
+        if (terrainPathLoss != nullptr)
+            pathLoss = terrainPathLoss->getBasePathLoss();
+        shadowingPathLoss = dynamic_cast<const ILoRaShadowingPathLoss *>(pathLoss);
+        if (useLinkBudgetCache)
+            buildLinkBudgetCache();
+    }
 }
 
-const W LoRaAnalogModel::getBackgroundNoisePower(const LoRaBandListening *listening) const {
-    //const LoRaBandListening *loRaListening = check_and_cast<const LoRaBandListening *>(listening);
-    //Sensitivity values from Semtech SX1272/73 datasheet, table 10, Rev 3.1, March 2017
-    W noisePower = W(math::dBmW2mW(-126.5) / 1000);
-    if(listening->getLoRaSF() == 6)
-    {
-        if(listening->getLoRaBW() == Hz(125000)) noisePower = W(math::dBmW2mW(-121) / 1000);
-        if(listening->getLoRaBW() == Hz(250000)) noisePower = W(math::dBmW2mW(-118) / 1000);
-        if(listening->getLoRaBW() == Hz(500000)) noisePower = W(math::dBmW2mW(-111) / 1000);
+void LoRaAnalogModel::finish()
+{
+    if (useLinkBudgetCache) {
+        recordScalar("link budget cache hits", linkBudgetHitCount.load());
+        recordScalar("link budget cache misses", linkBudgetMissCount.load());
+        if (linkBudgetHitCount == 0 && linkBudgetMissCount > 0)
+            EV_WARN << "The link budget cache was never hit, check that the radios are stationary and transmit on the channel of their radio" << endl;
     }
+}
 
-    if (listening->getLoRaSF() == 7)
-    {
-        if(listening->getLoRaBW() == Hz(125000)) noisePower = W(math::dBmW2mW(-124) / 1000);
-        if(listening->getLoRaBW() == Hz(250000)) noisePower = W(math::dBmW2mW(-122) / 1000);
-        if(listening->getLoRaBW() == Hz(500000)) noisePower = W(math::dBmW2mW(-116) / 1000);
-    }
+void LoRaAnalogModel::buildLinkBudgetCache()
+{
+    const LoRaMedium *radioMedium = check_and_cast<const LoRaMedium *>(getParentModule());
+    std::vector<const IRadio *> radios;
+    radioMedium->mapRadios([&] (const IRadio *radio) {
+        if (radio != nullptr && radio->getAntenna()->getMobility()->getMaxSpeed() == 0)
+            radios.push_back(radio);
+    });
+    for (auto radio : radios)
+        linkBudgetRadios[radio->getId()] = radio;
+    for (auto transmitterRadio : radios)
+        addLinkBudgetLinks(transmitterRadio);
+    EV_INFO << "Link budget cache holds " << linkBudgetCache.size() << " links between " << radios.size() << " stationary radios" << endl;
+}
 
-    if(listening->getLoRaSF() == 8)
-    {
-        if(listening->getLoRaBW() == Hz(125000)) noisePower = W(math::dBmW2mW(-127) / 1000);
-        if(listening->getLoRaBW() == Hz(250000)) noisePower = W(math::dBmW2mW(-125) / 1000);
-        if(listening->getLoRaBW() == Hz(500000)) noisePower = W(math::dBmW2mW(-119) / 1000);
-    }
-    if(listening->getLoRaSF() == 9)
-    {
-        if(listening->getLoRaBW() == Hz(125000)) noisePower = W(math::dBmW2mW(-130) / 1000);
-        if(listening->getLoRaBW() == Hz(250000)) noisePower = W(math::dBmW2mW(-128) / 1000);
-        if(listening->getLoRaBW() == Hz(500000)) noisePower = W(math::dBmW2mW(-122) / 1000);
-    }
-    if(listening->getLoRaSF() == 10)
-    {
-        if(listening->getLoRaBW() == Hz(125000)) noisePower = W(math::dBmW2mW(-133) / 1000);
-        if(listening->getLoRaBW() == Hz(250000)) noisePower = W(math::dBmW2mW(-130) / 1000);
-        if(listening->getLoRaBW() == Hz(500000)) noisePower = W(math::dBmW2mW(-125) / 1000);
-    }
-    if(listening->getLoRaSF() == 11)
-    {
-        if(listening->getLoRaBW() == Hz(125000)) noisePower = W(math::dBmW2mW(-135) / 1000);
-        if(listening->getLoRaBW() == Hz(250000)) noisePower = W(math::dBmW2mW(-132) / 1000);
-        if(listening->getLoRaBW() == Hz(500000)) noisePower = W(math::dBmW2mW(-128) / 1000);
-    }
-    if(listening->getLoRaSF() == 12)
-    {
-        if(listening->getLoRaBW() == Hz(125000)) noisePower = W(math::dBmW2mW(-137) / 1000);
-        if(listening->getLoRaBW() == Hz(250000)) noisePower = W(math::dBmW2mW(-135) / 1000);
-        if(listening->getLoRaBW() == Hz(500000)) noisePower = W(math::dBmW2mW(-129) / 1000);
+void LoRaAnalogModel::addLinkBudgetLinks(const IRadio *transmitterRadio) const
+{
+    // links are kept when the strongest transmitter could still reach the
+    // lowest sensitivity with a shadowing margin on top of the mean loss
+    double minLinkGain = math::dB2fraction(linkBudgetMinPower - linkBudgetMaxTransmissionPower - linkBudgetMargin);
+    Hz centerFrequency = getLinkBudgetFrequency(transmitterRadio);
+    linkBudgetFrequencies[transmitterRadio->getId()] = centerFrequency;
+    for (auto& it : linkBudgetRadios) {
+        const IRadio *receiverRadio = it.second;
+        if (receiverRadio == transmitterRadio || receiverRadio->getReceiver() == nullptr)
+            continue;
+        double gain = computeMeanLinkGain(transmitterRadio, receiverRadio, centerFrequency);
+        if (gain >= minLinkGain)
+            linkBudgetCache[getLinkKey(transmitterRadio->getId(), it.first)] = gain;
     }
-    return noisePower;
+}
+
+void LoRaAnalogModel::updateLinkBudgetCache(const IRadio *transmitterRadio) const
+{
+    auto it = linkBudgetFrequencies.find(transmitterRadio->getId());
+    if (it == linkBudgetFrequencies.end() || it->second == getLinkBudgetFrequency(transmitterRadio))
+        return;
+    for (auto& receiver : linkBudgetRadios)
+        linkBudgetCache.erase(getLinkKey(transmitterRadio->getId(), receiver.first));
+    addLinkBudgetLinks(transmitterRadio);
+}
+
+Hz LoRaAnalogModel::getLinkBudgetFrequency(const IRadio *transmitterRadio) const
+{
+    // end nodes transmit on the channel of their radio, gateways on the configured one
+    auto loRaRadio = dynamic_cast<const LoRaRadio *>(transmitterRadio);
+    if (loRaRadio != nullptr && !loRaRadio->iAmGateway)
+        return loRaRadio->loRaCF;
+    return check_and_cast<const NarrowbandTransmitterBase *>(transmitterRadio->getTransmitter())->getCenterFrequency();
+}
+
+double LoRaAnalogModel::computeMeanLinkGain(const IRadio *transmitterRadio, const IRadio *receiverRadio, Hz centerFrequency) const
+{
+    const IRadioMedium *radioMedium = receiverRadio->getMedium();
+    IMobility *transmitterMobility = transmitterRadio->getAntenna()->getMobility();
+    IMobility *receiverMobility = receiverRadio->getAntenna()->getMobility();
+    const Coord transmitterPosition = transmitterMobility->getCurrentPosition();
+    const Coord receiverPosition = receiverMobility->getCurrentPosition();
+    double transmitterAntennaGain = computeAntennaGain(transmitterRadio->getAntenna()->getGain().get(), transmitterPosition, receiverPosition, transmitterMobility->getCurrentAngularPosition());
+    double receiverAntennaGain = computeAntennaGain(receiverRadio->getAntenna()->getGain().get(), receiverPosition, transmitterPosition, receiverMobility->getCurrentAngularPosition());
+    mps propagationSpeed = radioMedium->getPropagation()->getPropagationSpeed();
+    m distance = m(transmitterPosition.distance(receiverPosition));
+    double pathLoss = shadowingPathLoss ? shadowingPathLoss->computeMeanPathLoss(propagationSpeed, centerFrequency, distance) : radioMedium->getPathLoss()->computePathLoss(propagationSpeed, centerFrequency, distance);
+    double terrainLoss = terrainPathLoss ? terrainPathLoss->computeTerrainLoss(transmitterRadio, transmitterPosition, receiverRadio, receiverPosition, centerFrequency) : 1;
+    double obstacleLoss = radioMedium->getObstacleLoss() ? radioMedium->getObstacleLoss()->computeObstacleLoss(centerFrequency, transmitterPosition, receiverPosition) : 1;
+    return transmitterAntennaGain * receiverAntennaGain * pathLoss * terrainLoss * obstacleLoss;
+}
+
+std::ostream& LoRaAnalogModel::printToStream(std::ostream& stream, int level, int evFlags) const
+{
+    return stream << "LoRaAnalogModel";
+}
+
+const W LoRaAnalogModel::getBackgroundNoisePower(const LoRaBandListening *listening) const {
+    return noiseFloorTable.getSensitivity(listening->getLoRaSF(), listening->getLoRaBW());
+}
+
+bool LoRaAnalogModel::isLinkBudgetCached(const ITransmission *transmission, int receiverId) const
+{
+    if (!useLinkBudgetCache || !linkBudgetRadios.count(receiverId))
+        return false;
+    auto it = linkBudgetFrequencies.find(transmission->getTransmitterId());
+    return it != linkBudgetFrequencies.end() && it->second == check_and_cast<const INarrowbandSignal *>(transmission->getAnalogModel())->getCenterFrequency();
 }
 
 W LoRaAnalogModel::computeReceptionPower(const IRadio *receiverRadio, const ITransmission *transmission, const IArrival *arrival) const
 {
+    bool cached = isLinkBudgetCached(transmission, receiverRadio->getId());
+    countLinkBudgetLookup(cached);
+    if (cached) {
+        // links out of reach draw no shadowing sample
+        auto it = linkBudgetCache.find(getLinkKey(transmission->getTransmitterId(), receiverRadio->getId()));
+        if (it == linkBudgetCache.end())
+            return W(0);
+        if (shadowingPathLoss == nullptr)
+            return check_and_cast<const IScalarSignal *>(transmission->getAnalogModel())->getPower() * std::min(1.0, it->second);
+    }
+    if (shadowingPathLoss && (cached || shadowingPathLoss->isCounterBasedShadowing()))
+        return computeReceptionPower(receiverRadio, transmission, arrival, shadowingPathLoss->computeShadowing(transmission->getId(), receiverRadio->getId()));
     const IRadioMedium *radioMedium = receiverRadio->getMedium();
 //    const IRadio *transmitterRadio = transmission->getTransmitter();
 //    const IAntenna *receiverAntenna = receiverRadio->getAntenna();
@@ -98,12 +173,46 @@ W LoRaAnalogModel::computeReceptionPower(const IRadio *receiverRadio, const ITra
     double transmitterAntennaGain = computeAntennaGain(transmission->getTransmitterAntennaGain(), transmission->getStartPosition(), arrival->getStartPosition(), transmission->getStartOrientation());
     double receiverAntennaGain = computeAntennaGain(receiverRadio->getAntenna()->getGain().get(), arrival->getStartPosition(), transmission->getStartPosition(), arrival->getStartOrientation());
     double pathLoss = radioMedium->getPathLoss()->computePathLoss(transmission, arrival);
+    double terrainLoss = computeTerrainLoss(transmission, receiverRadio, arrival, narrowbandSignalAnalogModel->getCenterFrequency());
     double obstacleLoss = radioMedium->getObstacleLoss() ? radioMedium->getObstacleLoss()->computeObstacleLoss(narrowbandSignalAnalogModel->getCenterFrequency(), transmission->getStartPosition(), receptionStartPosition) : 1;
     W transmissionPower = scalarSignalAnalogModel->getPower();
-    return transmissionPower * std::min(1.0, transmitterAntennaGain * receiverAntennaGain * pathLoss * obstacleLoss);
+    return transmissionPower * std::min(1.0, transmitterAntennaGain * receiverAntennaGain * pathLoss * terrainLoss * obstacleLoss);
+}
+
+W LoRaAnalogModel::computeReceptionPower(const IRadio *receiverRadio, const ITransmission *transmission, const IArrival *arrival, double shadowing) const
+{
+    W transmissionPower = check_and_cast<const IScalarSignal *>(transmission->getAnalogModel())->getPower();
+    double shadowingGain = math::dB2fraction(-shadowing);
+    if (isLinkBudgetCached(transmission, receiverRadio->getId())) {
+        auto it = linkBudgetCache.find(getLinkKey(transmission->getTransmitterId(), receiverRadio->getId()));
+        if (it == linkBudgetCache.end())
+            return W(0);
+        return transmissionPower * std::min(1.0, it->second * shadowingGain);
+    }
+    const IRadioMedium *radioMedium = receiverRadio->getMedium();
+    Hz centerFrequency = check_and_cast<const INarrowbandSignal *>(transmission->getAnalogModel())->getCenterFrequency();
+    double transmitterAntennaGain = computeAntennaGain(transmission->getTransmitterAntennaGain(), transmission->getStartPosition(), arrival->getStartPosition(), transmission->getStartOrientation());
+    double receiverAntennaGain = computeAntennaGain(receiverRadio->getAntenna()->getGain().get(), arrival->getStartPosition(), transmission->getStartPosition(), arrival->getStartOrientation());
+    mps propagationSpeed = radioMedium->getPropagation()->getPropagationSpeed();
+    m distance = m(arrival->getStartPosition().distance(transmission->getStartPosition()));
+    double pathLoss = shadowingPathLoss->computeMeanPathLoss(propagationSpeed, centerFrequency, distance) * shadowingGain;
+    double terrainLoss = computeTerrainLoss(transmission, receiverRadio, arrival, centerFrequency);
+    double obstacleLoss = radioMedium->getObstacleLoss() ? radioMedium->getObstacleLoss()->computeObstacleLoss(centerFrequency, transmission->getStartPosition(), arrival->getStartPosition()) : 1;
+    return transmissionPower * std::min(1.0, transmitterAntennaGain * receiverAntennaGain * pathLoss * terrainLoss * obstacleLoss);
 }
 
 const IReception *LoRaAnalogModel::computeReception(const IRadio *receiverRadio, const ITransmission *transmission, const IArrival *arrival) const
+{
+    return createReception(receiverRadio, transmission, arrival, computeReceptionPower(receiverRadio, transmission, arrival));
+}
+
+const IReception *LoRaAnalogModel::computeReception(const IRadio *receiverRadio, const ITransmission *transmission, const IArrival *arrival, double shadowing) const
+{
+    countLinkBudgetLookup(isLinkBudgetCached(transmission, receiverRadio->getId()));
+    return createReception(receiverRadio, transmission, arrival, computeReceptionPower(receiverRadio, transmission, arrival, shadowing));
+}
+
+const IReception *LoRaAnalogModel::createReception(const IRadio *receiverRadio, const ITransmission *transmission, const IArrival *arrival, W receivedPower) const
 {
     const LoRaTransmission *loRaTransmission = check_and_cast<const LoRaTransmission *>(transmission);
     const simtime_t receptionStartTime = arrival->getStartTime();
@@ -112,7 +221,6 @@ const IReception *LoRaAnalogModel::computeReception(const IRadio *receiverRadio,
     const Quaternion receptionEndOrientation = arrival->getEndOrientation();
     const Coord receptionStartPosition = arrival->getStartPosition();
     const Coord receptionEndPosition = arrival->getEndPosition();
-    W receivedPower = computeReceptionPower(receiverRadio, transmission, arrival);
     Hz LoRaCF = loRaTransmission->getLoRaCF();
     int LoRaSF = loRaTransmission->getLoRaSF();
     Hz LoRaBW = loRaTransmission->getLoRaBW();
@@ -120,14 +228,13 @@ const IReception *LoRaAnalogModel::computeReception(const IRadio *receiverRadio,
     return new LoRaReception(receiverRadio, transmission, receptionStartTime, receptionEndTime, receptionStartPosition, receptionEndPosition, receptionStartOrientation, receptionEndOrientation, LoRaCF, LoRaBW, receivedPower, LoRaSF, LoRaCR);
 }
 
-const INoise *LoRaAnalogModel::computeNoise(const IListening *listening, const IInterference *interference) const
+void LoRaAnalogModel::computeNoiseTimeline(const LoRaBandListening *listening, const IInterference *interference, simtime_t& noiseStartTime, simtime_t& noiseEndTime) const
 {
-    const LoRaBandListening *bandListening = check_and_cast<const LoRaBandListening *>(listening);
-    Hz commonCarrierFrequency = bandListening->getLoRaCF();
-    Hz commonBandwidth = bandListening->getLoRaBW();
-    simtime_t noiseStartTime = SimTime::getMaxTime();
-    simtime_t noiseEndTime = 0;
-    std::map<simtime_t, W> *powerChanges = new std::map<simtime_t, W>();
+    Hz commonCarrierFrequency = listening->getLoRaCF();
+    Hz commonBandwidth = listening->getLoRaBW();
+    noiseStartTime = SimTime::getMaxTime();
+    noiseEndTime = 0;
+    noiseTimeline.clear();
     const std::vector<const IReception *> *interferingReceptions = interference->getInterferingReceptions();
     for (auto reception : *interferingReceptions) {
         const ISignalAnalogModel *signalAnalogModel = reception->getAnalogModel();
@@ -145,44 +252,66 @@ const INoise *LoRaAnalogModel::computeNoise(const IListening *listening, const I
                 noiseStartTime = startTime;
             if (endTime > noiseEndTime)
                 noiseEndTime = endTime;
-            std::map<simtime_t, W>::iterator itStartTime = powerChanges->find(startTime);
-            if (itStartTime != powerChanges->end())
-                itStartTime->second += power;
-            else
-                powerChanges->insert(std::pair<simtime_t, W>(startTime, power));
-            std::map<simtime_t, W>::iterator itEndTime = powerChanges->find(endTime);
-            if (itEndTime != powerChanges->end())
-                itEndTime->second -= power;
-            else
-                powerChanges->insert(std::pair<simtime_t, W>(endTime, -power));
+            noiseTimeline.push_back({startTime, power, (int)noiseTimeline.size()});
+            noiseTimeline.push_back({endTime, -power, (int)noiseTimeline.size()});
         }
         else if (areOverlappingBands(commonCarrierFrequency, commonBandwidth, narrowbandSignalAnalogModel->getCenterFrequency(), narrowbandSignalAnalogModel->getBandwidth()))
             throw cRuntimeError("Overlapping bands are not supported");
     }
 
-    simtime_t startTime = listening->getStartTime();
-    simtime_t endTime = listening->getEndTime();
-    std::map<simtime_t, W> *backgroundNoisePowerChanges = new std::map<simtime_t, W>();
-    const W noisePower = getBackgroundNoisePower(bandListening);
-    backgroundNoisePowerChanges->insert(std::pair<simtime_t, W>(startTime, noisePower));
-    backgroundNoisePowerChanges->insert(std::pair<simtime_t, W>(endTime, -noisePower));
-
-    for (const auto & backgroundNoisePowerChange : *backgroundNoisePowerChanges) {
-        std::map<simtime_t, W>::iterator jt = powerChanges->find(backgroundNoisePowerChange.first);
-        if (jt != powerChanges->end())
-            jt->second += backgroundNoisePowerChange.second;
+    // background noise is constant over the whole listening
+    const W noisePower = getBackgroundNoisePower(listening);
+    noiseTimeline.push_back({listening->getStartTime(), noisePower, (int)noiseTimeline.size()});
+    noiseTimeline.push_back({listening->getEndTime(), -noisePower, (int)noiseTimeline.size()});
+
+    std::sort(noiseTimeline.begin(), noiseTimeline.end(), [] (const NoisePowerChange& a, const NoisePowerChange& b) {
+        return a.time < b.time || (a.time == b.time && a.order < b.order);
+    });
+    size_t size = 0;
+    for (auto& change : noiseTimeline) {
+        if (size != 0 && noiseTimeline[size - 1].time == change.time)
+            noiseTimeline[size - 1].power += change.power;
         else
-            powerChanges->insert(std::pair<simtime_t, W>(backgroundNoisePowerChange.first, backgroundNoisePowerChange.second));
+            noiseTimeline[size++] = change;
     }
+    noiseTimeline.erase(noiseTimeline.begin() + size, noiseTimeline.end());
+}
 
+const INoise *LoRaAnalogModel::computeNoise(const IListening *listening, const IInterference *interference) const
+{
+    const LoRaBandListening *bandListening = check_and_cast<const LoRaBandListening *>(listening);
+    simtime_t noiseStartTime;
+    simtime_t noiseEndTime;
+    computeNoiseTimeline(bandListening, interference, noiseStartTime, noiseEndTime);
+    std::map<simtime_t, W> *powerChanges = new std::map<simtime_t, W>();
     EV_TRACE << "Noise power begin " << endl;
     W noise = W(0);
-    for (std::map<simtime_t, W>::const_iterator it = powerChanges->begin(); it != powerChanges->end(); it++) {
-        noise += it->second;
-        EV_TRACE << "Noise at " << it->first << " = " << noise << endl;
+    for (auto& change : noiseTimeline) {
+        powerChanges->emplace_hint(powerChanges->end(), change.time, change.power);
+        noise += change.power;
+        EV_TRACE << "Noise at " << change.time << " = " << noise << endl;
     }
     EV_TRACE << "Noise power end" << endl;
-    return new ScalarNoise(noiseStartTime, noiseEndTime, commonCarrierFrequency, commonBandwidth, powerChanges);
+    return new ScalarNoise(noiseStartTime, noiseEndTime, bandListening->getLoRaCF(), bandListening->getLoRaBW(), powerChanges);
+}
+
+W LoRaAnalogModel::computeMaxNoisePower(const LoRaBandListening *listening, const IInterference *interference) const
+{
+    simtime_t noiseStartTime;
+    simtime_t noiseEndTime;
+    computeNoiseTimeline(listening, interference, noiseStartTime, noiseEndTime);
+    simtime_t startTime = listening->getStartTime();
+    simtime_t endTime = listening->getEndTime();
+    W noisePower = W(0);
+    W maxNoisePower = W(NaN);
+    for (auto& change : noiseTimeline) {
+        noisePower += change.power;
+        if (change.time >= endTime)
+            break;
+        if (change.time >= startTime && (std::isnan(maxNoisePower.get()) || noisePower > maxNoisePower))
+            maxNoisePower = noisePower;
+    }
+    return maxNoisePower;
 }
 
 const ISnir *LoRaAnalogModel::computeSNIR(const IReception *reception, const INoise *noise) const
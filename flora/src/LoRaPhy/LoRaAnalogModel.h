@@ -21,17 +21,100 @@
 #include "inet/physicallayer/wireless/common/analogmodel/packetlevel/ScalarNoise.h"
 
 #include "LoRaBandListening.h"
+#include "ILoRaShadowingPathLoss.h"
+#include "LoRaTerrainPathLoss.h"
+#include "LoRaSensitivityTable.h"
+#include <atomic>
+#include <unordered_map>
 
 namespace flora {
 
 class LoRaAnalogModel : public ScalarAnalogModelBase
 {
+  protected:
+    /** Background noise per SF and bandwidth, equal to the receiver sensitivity by default. */
+    LoRaSensitivityTable noiseFloorTable;
+
+    struct NoisePowerChange {
+        simtime_t time;
+        W power;
+        int order; // insertion order, keeps the summation order of simultaneous changes
+    };
+    /** Sorted power changes of the last computeNoiseTimeline call, reused to avoid allocations. */
+    mutable std::vector<NoisePowerChange> noiseTimeline;
+
+    /** @name Link budget cache for stationary radios */
+    //@{
+    bool useLinkBudgetCache = false;
+    double linkBudgetMinPower = NaN;            // dBm
+    double linkBudgetMaxTransmissionPower = NaN; // dBm
+    double linkBudgetMargin = NaN;              // dB
+    const ILoRaShadowingPathLoss *shadowingPathLoss = nullptr;
+    /** Set if the path loss is decorated with the terrain diffraction loss. */
+    const LoRaTerrainPathLoss *terrainPathLoss = nullptr;
+    /**
+     * Mean gain (antenna gains, path loss without shadowing, terrain and
+     * obstacle loss) as a fraction, keyed on (transmitter id, receiver id).
+     * Only the links that can reach linkBudgetMinPower are stored. Mutable
+     * for updateLinkBudgetCache(), which runs on the simulation thread only.
+     */
+    mutable std::unordered_map<uint64_t, double> linkBudgetCache;
+    /**
+     * Center frequency the links of each transmitter were evaluated at. Other
+     * transmissions of the transmitter take the uncached path.
+     */
+    mutable std::unordered_map<int, Hz> linkBudgetFrequencies;
+    /** Radios whose links were evaluated when building the cache, by id. */
+    std::unordered_map<int, const IRadio *> linkBudgetRadios;
+    /** Receptions served from the cache and computed without it, also counted on worker threads. */
+    mutable std::atomic<long> linkBudgetHitCount{0};
+    mutable std::atomic<long> linkBudgetMissCount{0};
+    //@}
+
+  protected:
+    virtual int numInitStages() const override { return NUM_INIT_STAGES; }
+    virtual void initialize(int stage) override;
+    virtual void finish() override;
+    virtual void buildLinkBudgetCache();
+    virtual void addLinkBudgetLinks(const IRadio *transmitterRadio) const;
+    virtual Hz getLinkBudgetFrequency(const IRadio *transmitterRadio) const;
+    virtual double computeMeanLinkGain(const IRadio *transmitterRadio, const IRadio *receiverRadio, Hz centerFrequency) const;
+    double computeTerrainLoss(const ITransmission *transmission, const IRadio *receiverRadio, const IArrival *arrival, Hz frequency) const {
+        return terrainPathLoss ? terrainPathLoss->computeTerrainLoss(transmission->getTransmitter(), transmission->getStartPosition(), receiverRadio, arrival->getStartPosition(), frequency) : 1;
+    }
+    virtual void computeNoiseTimeline(const LoRaBandListening *listening, const IInterference *interference, simtime_t& noiseStartTime, simtime_t& noiseEndTime) const;
+    virtual bool isLinkBudgetCached(const ITransmission *transmission, int receiverId) const;
+    void countLinkBudgetLookup(bool cached) const {
+        if (useLinkBudgetCache)
+            (cached ? linkBudgetHitCount : linkBudgetMissCount).fetch_add(1, std::memory_order_relaxed);
+    }
+    virtual const IReception *createReception(const IRadio *radio, const ITransmission *transmission, const IArrival *arrival, W receivedPower) const;
+    static uint64_t getLinkKey(int transmitterId, int receiverId) { return ((uint64_t)(uint32_t)transmitterId << 32) | (uint32_t)receiverId; }
+
   public:
     const W getBackgroundNoisePower(const LoRaBandListening *listening) const;
     virtual std::ostream& printToStream(std::ostream& stream, int level, int evFlags = 0) const override;
     virtual W computeReceptionPower(const IRadio *radio, const ITransmission *transmission, const IArrival *arrival) const override;
     virtual const IReception *computeReception(const IRadio *radio, const ITransmission *transmission, const IArrival *arrival) const override;
+    /**
+     * Returns the shadowing model if receptions are computed as mean path loss
+     * plus a per-link shadowing sample; nullptr otherwise.
+     */
+    const ILoRaShadowingPathLoss *getShadowingPathLoss() const { return shadowingPathLoss; }
+    /**
+     * Same as above with the shadowing sample (dB) given by the caller, e.g.
+     * from ILoRaShadowingPathLoss::computeShadowing for a whole batch of
+     * receivers. Requires getShadowingPathLoss(). Apart from the obstacle
+     * loss it only reads immutable state (the terrain loss cache is locked),
+     * so it may run on worker threads.
+     */
+    virtual W computeReceptionPower(const IRadio *radio, const ITransmission *transmission, const IArrival *arrival, double shadowing) const;
+    virtual const IReception *computeReception(const IRadio *radio, const ITransmission *transmission, const IArrival *arrival, double shadowing) const;
+    /** Re-evaluates the cached links of a transmitter whose center frequency changed. */
+    virtual void updateLinkBudgetCache(const IRadio *transmitterRadio) const;
     const INoise *computeNoise(const IListening *listening, const IInterference *interference) const override;
+    /** Same result as computeNoise(...)->computeMaxPower(listening start, listening end) without building the noise object. */
+    virtual W computeMaxNoisePower(const LoRaBandListening *listening, const IInterference *interference) const;
     virtual const ISnir *computeSNIR(const IReception *reception, const INoise *noise) const override;
 };
 
@@ -0,0 +1,107 @@
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see http://www.gnu.org/licenses/.
+//
+
+#ifndef LORAPHY_LORAARENA_H_
+#define LORAPHY_LORAARENA_H_
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+namespace flora {
+
+/**
+ * One contiguous block holding the cache entries of one transmission. Each
+ * object is preceded by a pointer to its block and the block is freed in bulk
+ * once it was released by its owner and the last of its objects was deleted.
+ * The objects keep their usual owner, e.g. the communication cache deletes
+ * them as before, only their memory comes from here (see LoRaArenaObject).
+ * Not thread safe, objects must be created and deleted on the simulation thread.
+ */
+class LoRaArenaBlock
+{
+  protected:
+    static constexpr size_t ALIGNMENT = alignof(std::max_align_t);
+    static constexpr size_t HEADER_SIZE = (sizeof(LoRaArenaBlock *) + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+
+    size_t capacity;
+    size_t used = 0;
+    int numObjects = 0;
+    bool released = false;
+
+  protected:
+    explicit LoRaArenaBlock(size_t capacity) : capacity(capacity) {}
+    static size_t getDataOffset() { return (sizeof(LoRaArenaBlock) + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT; }
+    char *getData() { return reinterpret_cast<char *>(this) + getDataOffset(); }
+
+  public:
+    /** Bytes taken by an object of the given size, including its header. */
+    static constexpr size_t getAllocationSize(size_t size) { return HEADER_SIZE + (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT; }
+
+    static LoRaArenaBlock *create(size_t capacity) {
+        void *memory = std::malloc(getDataOffset() + capacity);
+        if (memory == nullptr)
+            throw std::bad_alloc();
+        return new (memory) LoRaArenaBlock(capacity);
+    }
+
+    /** Capacity plus the block header. */
+    size_t getSize() const { return getDataOffset() + capacity; }
+
+    void *allocate(size_t size) {
+        size_t allocationSize = getAllocationSize(size);
+        if (released || used + allocationSize > capacity)
+            throw std::bad_alloc();
+        char *header = getData() + used;
+        *reinterpret_cast<LoRaArenaBlock **>(header) = this;
+        used += allocationSize;
+        numObjects++;
+        return header + HEADER_SIZE;
+    }
+
+    /** No more objects are allocated, the block goes away with its last object. */
+    void release() {
+        released = true;
+        if (numObjects == 0)
+            std::free(this);
+    }
+
+    static void deallocate(void *object) {
+        LoRaArenaBlock *block = *reinterpret_cast<LoRaArenaBlock **>(static_cast<char *>(object) - HEADER_SIZE);
+        if (--block->numObjects == 0 && block->released)
+            std::free(block);
+    }
+};
+
+/**
+ * T allocated from a LoRaArenaBlock. Deleting it through a pointer to any
+ * base with a virtual destructor returns its memory to the block.
+ */
+template<typename T>
+class LoRaArenaObject : public T
+{
+  public:
+    using T::T;
+    LoRaArenaObject(const T& other) : T(other) {}
+
+    static void *operator new(size_t size, LoRaArenaBlock *block) { return block->allocate(size); }
+    static void operator delete(void *object) { LoRaArenaBlock::deallocate(object); }
+    // only called if the constructor throws
+    static void operator delete(void *object, LoRaArenaBlock *) { LoRaArenaBlock::deallocate(object); }
+};
+
+} // namespace flora
+
+#endif /* LORAPHY_LORAARENA_H_ */
@@ -0,0 +1,123 @@
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see http://www.gnu.org/licenses/.
+//
+
+#ifndef LORAPHY_LORACOUNTERRNG_H_
+#define LORAPHY_LORACOUNTERRNG_H_
+
+#include <cmath>
+#include <cstdint>
+
+namespace flora {
+
+/**
+ * Counter-based Philox4x32-10 generator (Salmon et al., "Parallel random
+ * numbers: as easy as 1, 2, 3", SC'11). Every (a, b) counter maps to its
+ * own sample, so the result does not depend on the order or the thread in
+ * which the samples are drawn. The key selects the stream, e.g. from the
+ * seed set of the run.
+ */
+class LoRaCounterRng
+{
+  protected:
+    uint32_t key[2];
+
+  protected:
+    static void mulhilo(uint32_t a, uint32_t b, uint32_t& hi, uint32_t& lo) {
+        uint64_t product = (uint64_t)a * b;
+        hi = (uint32_t)(product >> 32);
+        lo = (uint32_t)product;
+    }
+
+    static void philox(uint32_t counter[4], uint32_t key0, uint32_t key1) {
+        for (int round = 0; round < 10; round++) {
+            uint32_t hi0, lo0, hi1, lo1;
+            mulhilo(0xD2511F53, counter[0], hi0, lo0);
+            mulhilo(0xCD9E8D57, counter[2], hi1, lo1);
+            uint32_t c0 = hi1 ^ counter[1] ^ key0;
+            uint32_t c2 = hi0 ^ counter[3] ^ key1;
+            counter[0] = c0;
+            counter[1] = lo1;
+            counter[2] = c2;
+            counter[3] = lo0;
+            key0 += 0x9E3779B9;
+            key1 += 0xBB67AE85;
+        }
+    }
+
+    /** Maps 64 random bits to a double in the open interval (0, 1). */
+    static double toOpenUnit(uint32_t hi, uint32_t lo) {
+        return ((((uint64_t)hi << 32) | lo) >> 11) * 0x1.0p-53 + 0x1.0p-54;
+    }
+
+  public:
+    explicit LoRaCounterRng(uint64_t seed = 0) { setSeed(seed); }
+
+    void setSeed(uint64_t seed) {
+        key[0] = (uint32_t)seed;
+        key[1] = (uint32_t)(seed >> 32);
+    }
+
+    /** Standard normal sample (Box-Muller) for the counter (a, b). */
+    double normal(uint64_t a, uint32_t b) const {
+        uint32_t counter[4] = {(uint32_t)a, (uint32_t)(a >> 32), b, 0};
+        philox(counter, key[0], key[1]);
+        double u1 = toOpenUnit(counter[0], counter[1]);
+        double u2 = toOpenUnit(counter[2], counter[3]);
+        return std::sqrt(-2 * std::log(u1)) * std::cos(2 * M_PI * u2);
+    }
+
+    /**
+     * Standard normal samples for the counters (a, b[0]) ... (a, b[count - 1]),
+     * equal to calling normal(a, b[i]) for each. The Philox rounds run over
+     * the whole batch first so the compiler can vectorize them.
+     */
+    void normal(uint64_t a, const int *b, double *samples, int count) const {
+        constexpr int BATCH = 64;
+        uint32_t counters[4][BATCH];
+        for (int start = 0; start < count; start += BATCH) {
+            int n = count - start < BATCH ? count - start : BATCH;
+            for (int i = 0; i < n; i++) {
+                counters[0][i] = (uint32_t)a;
+                counters[1][i] = (uint32_t)(a >> 32);
+                counters[2][i] = (uint32_t)b[start + i];
+                counters[3][i] = 0;
+            }
+            uint32_t key0 = key[0], key1 = key[1];
+            for (int round = 0; round < 10; round++) {
+                for (int i = 0; i < n; i++) {
+                    uint64_t product0 = (uint64_t)0xD2511F53 * counters[0][i];
+                    uint64_t product1 = (uint64_t)0xCD9E8D57 * counters[2][i];
+                    uint32_t c0 = (uint32_t)(product1 >> 32) ^ counters[1][i] ^ key0;
+                    uint32_t c2 = (uint32_t)(product0 >> 32) ^ counters[3][i] ^ key1;
+                    counters[0][i] = c0;
+                    counters[1][i] = (uint32_t)product1;
+                    counters[2][i] = c2;
+                    counters[3][i] = (uint32_t)product0;
+                }
+                key0 += 0x9E3779B9;
+                key1 += 0xBB67AE85;
+            }
+            for (int i = 0; i < n; i++) {
+                double u1 = toOpenUnit(counters[0][i], counters[1][i]);
+                double u2 = toOpenUnit(counters[2][i], counters[3][i]);
+                samples[start + i] = std::sqrt(-2 * std::log(u1)) * std::cos(2 * M_PI * u2);
+            }
+        }
+    }
+};
+
+} // namespace flora
+
+#endif /* LORAPHY_LORACOUNTERRNG_H_ */
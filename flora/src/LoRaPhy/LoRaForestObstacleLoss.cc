@@ -0,0 +1,383 @@
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see http://www.gnu.org/licenses/.
+//
+
+#include "LoRaForestObstacleLoss.h"
+#include "inet/common/INETMath.h"
+#include "inet/common/ModuleAccess.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+namespace flora {
+
+Define_Module(LoRaForestObstacleLoss);
+
+static const char RASTER_MAGIC[8] = {'F', 'L', 'O', 'R', 'A', 'V', 'E', 'G'};
+static const uint32_t RASTER_VERSION = 1;
+
+struct RasterFileHeader
+{
+    char magic[8];
+    uint32_t version;
+    int32_t numColumns;
+    int32_t numRows;
+    uint32_t padding;
+    uint64_t sourceHash;
+    double cellSize;
+    double originX;
+    double originY;
+};
+
+static uint64_t hashBytes(uint64_t hash, const void *data, size_t size)
+{
+    // FNV-1a
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+size_t LoRaForestObstacleLoss::LinkKeyHash::operator()(const LinkKey& key) const
+{
+    return hashBytes(0xCBF29CE484222325ULL, key.values, sizeof(key.values));
+}
+
+void LoRaForestObstacleLoss::initialize(int stage)
+{
+    cModule::initialize(stage);
+    if (stage == INITSTAGE_LOCAL) {
+        const char *foliageModelString = par("foliageModel");
+        if (!strcmp(foliageModelString, "weissberger"))
+            foliageModel = FOLIAGE_WEISSBERGER;
+        else if (!strcmp(foliageModelString, "exponential"))
+            foliageModel = FOLIAGE_EXPONENTIAL;
+        else
+            throw cRuntimeError("Unknown foliage model '%s'", foliageModelString);
+        specificAttenuation = par("specificAttenuation");
+        maxAttenuation = par("maxAttenuation");
+        cellSize = par("cellSize");
+        if (!(cellSize > 0))
+            throw cRuntimeError("The vegetation raster cell size must be positive");
+        parseVegetationTags(par("vegetationTags"));
+    }
+    // the link budget cache of the analog model already needs the raster
+    else if (stage == INITSTAGE_PHYSICAL_ENVIRONMENT) {
+        const char *rasterFile = par("rasterFile");
+        uint64_t sourceHash = computeSourceHash();
+        if (*rasterFile != '\0' && loadRaster(rasterFile, sourceHash))
+            EV_INFO << "Loaded " << numColumns << "x" << numRows << " vegetation raster from " << rasterFile << endl;
+        else {
+            auto coordinateSystem = getModuleFromPar<IGeographicCoordinateSystem>(par("coordinateSystemModule"), this);
+            buildRaster(par("mapFile").xmlValue(), coordinateSystem);
+            EV_INFO << "Rasterized vegetation into " << numColumns << "x" << numRows << " cells of " << cellSize << " m" << endl;
+            if (*rasterFile != '\0')
+                saveRaster(rasterFile, sourceHash);
+        }
+    }
+}
+
+void LoRaForestObstacleLoss::finish()
+{
+    recordScalar("foliage loss computation count", linkLossComputationCount);
+    recordScalar("foliage loss cache hit count", linkLossCacheHitCount);
+}
+
+void LoRaForestObstacleLoss::parseVegetationTags(const char *tags)
+{
+    // "key=value:density key=value:density ..."
+    cStringTokenizer tokenizer(tags);
+    while (tokenizer.hasMoreTokens()) {
+        std::string token = tokenizer.nextToken();
+        size_t equals = token.find('=');
+        size_t colon = token.find(':', equals);
+        if (equals == std::string::npos || colon == std::string::npos)
+            throw cRuntimeError("Invalid vegetation tag '%s', expected key=value:density", token.c_str());
+        VegetationTag tag;
+        tag.key = token.substr(0, equals);
+        tag.value = token.substr(equals + 1, colon - equals - 1);
+        tag.density = atof(token.c_str() + colon + 1);
+        vegetationTags.push_back(tag);
+    }
+}
+
+double LoRaForestObstacleLoss::getVegetationDensity(const cXMLElement *element) const
+{
+    double result = 0;
+    for (auto tag : element->getChildrenByTagName("tag")) {
+        const char *key = tag->getAttribute("k");
+        const char *value = tag->getAttribute("v");
+        if (key == nullptr || value == nullptr)
+            continue;
+        for (auto& vegetationTag : vegetationTags)
+            if (vegetationTag.key == key && vegetationTag.value == value)
+                result = std::max(result, vegetationTag.density);
+    }
+    return result;
+}
+
+uint64_t LoRaForestObstacleLoss::computeSourceHash() const
+{
+    // everything the raster is derived from; a changed map file is only
+    // detected through its parameter text, see the NED documentation
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    std::string source = par("mapFile").str() + "|" + par("vegetationTags").stdstringValue();
+    cModule *coordinateSystemModule = getModuleByPath(par("coordinateSystemModule"));
+    if (coordinateSystemModule != nullptr)
+        for (int i = 0; i < coordinateSystemModule->getNumParams(); i++)
+            source += "|" + coordinateSystemModule->par(i).str();
+    hash = hashBytes(hash, source.data(), source.size());
+    return hashBytes(hash, &cellSize, sizeof(cellSize));
+}
+
+void LoRaForestObstacleLoss::buildRaster(const cXMLElement *map, IGeographicCoordinateSystem *coordinateSystem)
+{
+    std::unordered_map<std::string, Coord> nodes;
+    for (auto node : map->getChildrenByTagName("node")) {
+        const char *id = node->getAttribute("id");
+        const char *lat = node->getAttribute("lat");
+        const char *lon = node->getAttribute("lon");
+        if (id != nullptr && lat != nullptr && lon != nullptr)
+            nodes[id] = coordinateSystem->computeSceneCoordinate(GeoCoord(deg(atof(lat)), deg(atof(lon)), m(0)));
+    }
+    // closed ways become rings, unclosed ones (parts of split rings) are skipped
+    auto createRing = [&] (const cXMLElement *way, std::vector<Coord>& ring) {
+        for (auto nd : way->getChildrenByTagName("nd")) {
+            auto it = nodes.find(nd->getAttribute("ref"));
+            if (it == nodes.end())
+                return false;
+            ring.push_back(it->second);
+        }
+        return ring.size() >= 4 && ring.front() == ring.back();
+    };
+    std::unordered_map<std::string, const cXMLElement *> ways;
+    std::vector<std::pair<std::vector<std::vector<Coord>>, double>> polygons;
+    for (auto way : map->getChildrenByTagName("way")) {
+        ways[way->getAttribute("id")] = way;
+        double polygonDensity = getVegetationDensity(way);
+        std::vector<Coord> ring;
+        if (polygonDensity > 0 && createRing(way, ring))
+            polygons.push_back({{ring}, polygonDensity});
+    }
+    // multipolygon relations, inner rings are holes by the even-odd rule
+    for (auto relation : map->getChildrenByTagName("relation")) {
+        double polygonDensity = getVegetationDensity(relation);
+        if (polygonDensity <= 0)
+            continue;
+        std::vector<std::vector<Coord>> rings;
+        for (auto member : relation->getChildrenByTagName("member")) {
+            const char *type = member->getAttribute("type");
+            const char *ref = member->getAttribute("ref");
+            if (type == nullptr || ref == nullptr || strcmp(type, "way"))
+                continue;
+            auto it = ways.find(ref);
+            std::vector<Coord> ring;
+            if (it != ways.end() && createRing(it->second, ring))
+                rings.push_back(ring);
+        }
+        if (!rings.empty())
+            polygons.push_back({rings, polygonDensity});
+    }
+    numColumns = numRows = 0;
+    density.clear();
+    if (polygons.empty())
+        return;
+    double minX = INFINITY, minY = INFINITY, maxX = -INFINITY, maxY = -INFINITY;
+    for (auto& polygon : polygons)
+        for (auto& ring : polygon.first)
+            for (auto& point : ring) {
+                minX = std::min(minX, point.x);
+                minY = std::min(minY, point.y);
+                maxX = std::max(maxX, point.x);
+                maxY = std::max(maxY, point.y);
+            }
+    originX = minX;
+    originY = minY;
+    numColumns = (int)std::ceil((maxX - minX) / cellSize) + 1;
+    numRows = (int)std::ceil((maxY - minY) / cellSize) + 1;
+    density.assign((size_t)numColumns * numRows, 0);
+    for (auto& polygon : polygons)
+        rasterizePolygon(polygon.first, polygon.second);
+}
+
+void LoRaForestObstacleLoss::rasterizePolygon(const std::vector<std::vector<Coord>>& rings, double polygonDensity)
+{
+    // scanline fill of the cells whose center is inside the polygon
+    std::vector<double> crossings;
+    for (int row = 0; row < numRows; row++) {
+        double y = originY + (row + 0.5) * cellSize;
+        crossings.clear();
+        for (auto& ring : rings)
+            for (size_t i = 0; i + 1 < ring.size(); i++) {
+                const Coord& p = ring[i];
+                const Coord& q = ring[i + 1];
+                if ((p.y <= y) != (q.y <= y))
+                    crossings.push_back(p.x + (y - p.y) * (q.x - p.x) / (q.y - p.y));
+            }
+        std::sort(crossings.begin(), crossings.end());
+        for (size_t i = 0; i + 1 < crossings.size(); i += 2) {
+            int firstColumn = std::max(0, (int)std::ceil((crossings[i] - originX) / cellSize - 0.5));
+            int lastColumn = std::min(numColumns - 1, (int)std::floor((crossings[i + 1] - originX) / cellSize - 0.5));
+            float *cells = density.data() + (size_t)row * numColumns;
+            for (int column = firstColumn; column <= lastColumn; column++)
+                cells[column] = std::max(cells[column], (float)polygonDensity);
+        }
+    }
+}
+
+bool LoRaForestObstacleLoss::loadRaster(const char *fileName, uint64_t sourceHash)
+{
+    std::ifstream file(fileName, std::ios::binary);
+    if (!file)
+        return false;
+    RasterFileHeader header;
+    if (!file.read(reinterpret_cast<char *>(&header), sizeof(header)))
+        return false;
+    if (memcmp(header.magic, RASTER_MAGIC, sizeof(RASTER_MAGIC)) || header.version != RASTER_VERSION || header.sourceHash != sourceHash
+            || header.cellSize != cellSize || header.numColumns < 0 || header.numRows < 0)
+    {
+        EV_WARN << "Vegetation raster " << fileName << " does not match the current parameters, rebuilding it" << endl;
+        return false;
+    }
+    std::vector<float> cells((size_t)header.numColumns * header.numRows);
+    if (!file.read(reinterpret_cast<char *>(cells.data()), cells.size() * sizeof(float)))
+        return false;
+    numColumns = header.numColumns;
+    numRows = header.numRows;
+    originX = header.originX;
+    originY = header.originY;
+    density.swap(cells);
+    return true;
+}
+
+void LoRaForestObstacleLoss::saveRaster(const char *fileName, uint64_t sourceHash) const
+{
+    RasterFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, RASTER_MAGIC, sizeof(RASTER_MAGIC));
+    header.version = RASTER_VERSION;
+    header.numColumns = numColumns;
+    header.numRows = numRows;
+    header.sourceHash = sourceHash;
+    header.cellSize = cellSize;
+    header.originX = originX;
+    header.originY = originY;
+    std::ofstream file(fileName, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char *>(density.data()), density.size() * sizeof(float));
+    if (!file)
+        EV_WARN << "Cannot write vegetation raster " << fileName << endl;
+}
+
+double LoRaForestObstacleLoss::computeFoliageDepth(const Coord& from, const Coord& to) const
+{
+    if (numColumns == 0 || numRows == 0)
+        return 0;
+    // grid coordinates, the link is the segment a + t * d with t in [0, 1]
+    double ax = (from.x - originX) / cellSize;
+    double ay = (from.y - originY) / cellSize;
+    double dx = (to.x - from.x) / cellSize;
+    double dy = (to.y - from.y) / cellSize;
+    double length = std::sqrt((to.x - from.x) * (to.x - from.x) + (to.y - from.y) * (to.y - from.y));
+    if (length == 0)
+        return 0;
+    // clip the segment to the raster
+    double t0 = 0, t1 = 1;
+    auto clip = [&] (double a, double d, double size) {
+        if (d == 0)
+            return a >= 0 && a < size;
+        double ta = (0 - a) / d;
+        double tb = (size - a) / d;
+        t0 = std::max(t0, std::min(ta, tb));
+        t1 = std::min(t1, std::max(ta, tb));
+        return t0 < t1;
+    };
+    if (!clip(ax, dx, numColumns) || !clip(ay, dy, numRows))
+        return 0;
+    // Amanatides-Woo traversal from t0 to t1, the entry cell is nudged in the
+    // direction of travel so that a start on a cell border picks the next cell
+    int column = std::min(numColumns - 1, std::max(0, (int)std::floor(ax + dx * t0 + (dx < 0 ? -1e-9 : 1e-9))));
+    int row = std::min(numRows - 1, std::max(0, (int)std::floor(ay + dy * t0 + (dy < 0 ? -1e-9 : 1e-9))));
+    int stepColumn = dx > 0 ? 1 : -1;
+    int stepRow = dy > 0 ? 1 : -1;
+    double tDeltaX = dx != 0 ? std::abs(1 / dx) : INFINITY;
+    double tDeltaY = dy != 0 ? std::abs(1 / dy) : INFINITY;
+    double tMaxX = dx != 0 ? ((dx > 0 ? column + 1 : column) - ax) / dx : INFINITY;
+    double tMaxY = dy != 0 ? ((dy > 0 ? row + 1 : row) - ay) / dy : INFINITY;
+    double depth = 0;
+    double t = t0;
+    while (t < t1 && column >= 0 && column < numColumns && row >= 0 && row < numRows) {
+        double tNext = std::min(std::min(tMaxX, tMaxY), t1);
+        depth += density[(size_t)row * numColumns + column] * (tNext - t);
+        t = tNext;
+        if (tMaxX < tMaxY) {
+            column += stepColumn;
+            tMaxX += tDeltaX;
+        }
+        else {
+            row += stepRow;
+            tMaxY += tDeltaY;
+        }
+    }
+    return depth * length;
+}
+
+double LoRaForestObstacleLoss::computeFoliageLoss(Hz frequency, double depth) const
+{
+    if (depth <= 0)
+        return 0;
+    switch (foliageModel) {
+        case FOLIAGE_WEISSBERGER: {
+            // Weissberger's modified exponential decay model, valid up to 400 m
+            double f = GHz(frequency).get();
+            double d = std::min(depth, 400.0);
+            if (d <= 14)
+                return 0.45 * std::pow(f, 0.284) * d;
+            return 1.33 * std::pow(f, 0.284) * std::pow(d, 0.588);
+        }
+        case FOLIAGE_EXPONENTIAL:
+            // ITU-R P.833 woodland path: A = Am * (1 - exp(-d * gamma / Am))
+            return maxAttenuation * (1 - std::exp(-depth * specificAttenuation / maxAttenuation));
+        default:
+            throw cRuntimeError("Unknown foliage model");
+    }
+}
+
+std::ostream& LoRaForestObstacleLoss::printToStream(std::ostream& stream, int level, int evFlags) const
+{
+    stream << "LoRaForestObstacleLoss";
+    if (level <= PRINT_LEVEL_TRACE)
+        stream << ", cellSize = " << cellSize
+               << ", numColumns = " << numColumns
+               << ", numRows = " << numRows;
+    return stream;
+}
+
+double LoRaForestObstacleLoss::computeObstacleLoss(Hz frequency, const Coord& transmissionPosition, const Coord& receptionPosition) const
+{
+    LinkKey key = {{frequency.get(), transmissionPosition.x, transmissionPosition.y, transmissionPosition.z, receptionPosition.x, receptionPosition.y, receptionPosition.z}};
+    auto it = linkLossCache.find(key);
+    if (it != linkLossCache.end()) {
+        linkLossCacheHitCount++;
+        return it->second;
+    }
+    linkLossComputationCount++;
+    double loss = math::dB2fraction(-computeFoliageLoss(frequency, computeFoliageDepth(transmissionPosition, receptionPosition)));
+    linkLossCache[key] = loss;
+    return loss;
+}
+
+} // namespace flora
@@ -0,0 +1,105 @@
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see http://www.gnu.org/licenses/.
+//
+
+#ifndef LORAPHY_LORAFORESTOBSTACLELOSS_H_
+#define LORAPHY_LORAFORESTOBSTACLELOSS_H_
+
+#include "inet/common/geometry/common/GeographicCoordinateSystem.h"
+#include "inet/physicallayer/wireless/common/contract/packetlevel/IObstacleLoss.h"
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+using namespace inet;
+using namespace inet::physicallayer;
+
+namespace flora {
+
+/**
+ * Foliage loss from the vegetation polygons of an OpenStreetMap file. The
+ * polygons are rasterized once into a grid of vegetation densities (0 ... 1),
+ * optionally cached in a binary file, and the loss of a link follows from the
+ * vegetation depth along it, integrated with a DDA grid traversal. Since the
+ * loss only depends on the end points, it is memoized per link.
+ */
+class LoRaForestObstacleLoss : public cModule, public IObstacleLoss
+{
+  protected:
+    enum FoliageModel {
+        FOLIAGE_WEISSBERGER,
+        FOLIAGE_EXPONENTIAL,
+    };
+
+    struct VegetationTag {
+        std::string key;
+        std::string value;
+        double density;
+    };
+
+    struct LinkKey {
+        double values[7];
+        bool operator==(const LinkKey& other) const { return memcmp(values, other.values, sizeof(values)) == 0; }
+    };
+
+    struct LinkKeyHash {
+        size_t operator()(const LinkKey& key) const;
+    };
+
+  protected:
+    FoliageModel foliageModel = FOLIAGE_WEISSBERGER;
+    double specificAttenuation = NaN; // dB/m
+    double maxAttenuation = NaN;      // dB
+    std::vector<VegetationTag> vegetationTags;
+
+    /** @name Vegetation raster, row major, cell (0, 0) starts at origin */
+    //@{
+    double cellSize = NaN;
+    double originX = 0;
+    double originY = 0;
+    int numColumns = 0;
+    int numRows = 0;
+    std::vector<float> density;
+    //@}
+
+    mutable std::unordered_map<LinkKey, double, LinkKeyHash> linkLossCache;
+    mutable long linkLossComputationCount = 0;
+    mutable long linkLossCacheHitCount = 0;
+
+  protected:
+    virtual int numInitStages() const override { return NUM_INIT_STAGES; }
+    virtual void initialize(int stage) override;
+    virtual void finish() override;
+
+    virtual void parseVegetationTags(const char *tags);
+    virtual double getVegetationDensity(const cXMLElement *element) const;
+    virtual uint64_t computeSourceHash() const;
+    virtual void buildRaster(const cXMLElement *map, IGeographicCoordinateSystem *coordinateSystem);
+    virtual void rasterizePolygon(const std::vector<std::vector<Coord>>& rings, double polygonDensity);
+    virtual bool loadRaster(const char *fileName, uint64_t sourceHash);
+    virtual void saveRaster(const char *fileName, uint64_t sourceHash) const;
+
+    /** Vegetation depth in meters along the ground projection of the link. */
+    virtual double computeFoliageDepth(const Coord& from, const Coord& to) const;
+    /** Foliage loss in dB for the given vegetation depth. */
+    virtual double computeFoliageLoss(Hz frequency, double depth) const;
+
+  public:
+    virtual std::ostream& printToStream(std::ostream& stream, int level, int evFlags = 0) const override;
+    virtual double computeObstacleLoss(Hz frequency, const Coord& transmissionPosition, const Coord& receptionPosition) const override;
+};
+
+} // namespace flora
+
+#endif /* LORAPHY_LORAFORESTOBSTACLELOSS_H_ */
@@ -26,9 +26,8 @@ LoRaLogNormalShadowing::LoRaLogNormalShadowing()
 
 void LoRaLogNormalShadowing::initialize(int stage)
 {
-    FreeSpacePathLoss::initialize(stage);
+    LoRaShadowingPathLossBase::initialize(stage);
     if (stage == INITSTAGE_LOCAL) {
-        sigma = par("sigma");
         gamma = par("gamma");
         d0 = m(par("d0"));
     }
@@ -52,13 +51,20 @@ double LoRaLogNormalShadowing::computePathLoss(mps propagationSpeed, Hz frequenc
     return math::dB2fraction(-PL_db);
 }
 
+double LoRaLogNormalShadowing::computeMeanPathLoss(mps propagationSpeed, Hz frequency, m distance) const
+{
+    double PL_d0_db = 127.41;
+    double PL_db = PL_d0_db + 10 * gamma * log10(unit(distance / d0).get());
+    return math::dB2fraction(-PL_db);
+}
+
 m LoRaLogNormalShadowing::computeRange(W transmissionPower) const
 {
     // parameters taken from paper "Do LoRa Low-Power Wide-Area Networks Scale?"
     double PL_d0_db = 127.41;
     double max_sensitivity = -137;
     double trans_power_db = round(10 * log10(transmissionPower.get()*1000));
-    EV << "LoRaLogNormalShadowing transmissionPower in W = " << transmissionPower << " in dBm = " << trans_power_db << endl;
+    EV_TRACE << "LoRaLogNormalShadowing transmissionPower in W = " << transmissionPower << " in dBm = " << trans_power_db << endl;
     double rhs = (trans_power_db - PL_d0_db - max_sensitivity)/(10 * gamma);
     double distance = d0.get() * pow(10, rhs);
     return m(distance);
@@ -16,7 +16,7 @@
 #ifndef LORAPHY_LORALOGNORMALSHADOWING_H_
 #define LORAPHY_LORALOGNORMALSHADOWING_H_
 
-#include "inet/physicallayer/wireless/common/pathloss/FreeSpacePathLoss.h"
+#include "LoRaPhy/LoRaShadowingPathLossBase.h"
 
 using namespace inet;
 using namespace inet::physicallayer;
@@ -25,12 +25,11 @@ namespace flora {
 /**
  * This class implements the log normal shadowing model.
  */
-class LoRaLogNormalShadowing : public FreeSpacePathLoss
+class LoRaLogNormalShadowing : public LoRaShadowingPathLossBase
 {
   protected:
     m d0;
     double gamma;
-    double sigma;
 
   protected:
     virtual void initialize(int stage) override;
@@ -40,6 +39,7 @@ class LoRaLogNormalShadowing : public FreeSpacePathLoss
     virtual std::ostream& printToStream(std::ostream& stream, int level, int evFlags = 0) const override;
     //virtual double computePathLoss(const ITransmission *transmission, const IArrival *arrival) const override;
     virtual double computePathLoss(mps propagationSpeed, Hz frequency, m distance) const override;
+    virtual double computeMeanPathLoss(mps propagationSpeed, Hz frequency, m distance) const override;
     m computeRange(W transmissionPower) const;
 };
 
@@ -15,7 +15,9 @@
 #include "LoRaMedium.h"
 #include "../LoRa/LoRaMacFrame_m.h"
 #include "LoRaBandListening.h"
+#include "LoRaAnalogModel.h"
 #include "LoRaTransmission.h"
+#include "LoRaReceptionResult.h"
 #include "inet/common/INETUtils.h"
 #include "inet/common/ModuleAccess.h"
 #include "inet/common/Simsignals.h"
@@ -29,6 +31,8 @@
 #include "inet/physicallayer/wireless/common/medium/RadioMedium.h"
 #include "inet/physicallayer/wireless/common/contract/packetlevel/SignalTag_m.h"
 #include "inet/physicallayer/wireless/common/contract/packetlevel/IErrorModel.h"
+#include "inet/physicallayer/wireless/common/signal/Arrival.h"
+#include "inet/physicallayer/wireless/common/signal/Interference.h"
 
 namespace flora {
 
@@ -40,6 +44,102 @@ LoRaMedium::LoRaMedium() : RadioMedium()
 
 LoRaMedium::~LoRaMedium()
 {
+    delete workerPool;
+}
+
+void LoRaMedium::initialize(int stage)
+{
+    RadioMedium::initialize(stage);
+    if (stage == INITSTAGE_LOCAL) {
+        skipSleepingReceivers = par("skipSleepingReceivers");
+        int numWorkerThreads = par("numWorkerThreads");
+        parallelFanOutThreshold = par("parallelFanOutThreshold");
+        errorModel = dynamic_cast<IErrorModel *>(getSubmodule("errorModel"));
+        if (numWorkerThreads > 1)
+            workerPool = new LoRaWorkerPool(numWorkerThreads);
+    }
+}
+
+void LoRaMedium::finish()
+{
+    RadioMedium::finish();
+    if (skipSleepingReceivers) {
+        recordScalar("skipped receivers", skippedReceiverCount);
+        recordScalar("picked up signals", pickedUpSignalCount);
+    }
+    if (workerPool != nullptr)
+        recordScalar("parallel reception computation count", parallelReceptionCount);
+    recordScalar("cache arena block count", arenaBlockCount);
+    recordScalar("cache arena bytes per entry", arenaEntryCount > 0 ? (double)arenaByteCount / arenaEntryCount : 0.0);
+}
+
+void LoRaMedium::addRadio(const IRadio *radio)
+{
+    RadioMedium::addRadio(radio);
+    registerRadio(radio);
+}
+
+void LoRaMedium::removeRadio(const IRadio *radio)
+{
+    unregisterRadio(radio);
+    radioMacAddresses.erase(radio->getId());
+    RadioMedium::removeRadio(radio);
+}
+
+void LoRaMedium::updateRadioChannel(const IRadio *radio)
+{
+    if (radioChannels.find(radio->getId()) != radioChannels.end()) {
+        unregisterRadio(radio);
+        registerRadio(radio);
+    }
+    // the cached link gains depend on the frequency through the terrain and obstacle loss
+    if (auto loRaAnalogModel = dynamic_cast<const LoRaAnalogModel *>(analogModel))
+        loRaAnalogModel->updateLinkBudgetCache(radio);
+}
+
+void LoRaMedium::registerRadio(const IRadio *radio)
+{
+    auto loRaRadio = dynamic_cast<const LoRaRadio *>(radio);
+    if (loRaRadio == nullptr || loRaRadio->iAmGateway)
+        gatewayRadios.push_back(radio);
+    else {
+        channelRadios[loRaRadio->loRaCF].push_back(radio);
+        radioChannels[radio->getId()] = loRaRadio->loRaCF;
+    }
+}
+
+void LoRaMedium::unregisterRadio(const IRadio *radio)
+{
+    auto it = radioChannels.find(radio->getId());
+    if (it == radioChannels.end())
+        gatewayRadios.erase(std::remove(gatewayRadios.begin(), gatewayRadios.end(), radio), gatewayRadios.end());
+    else {
+        auto& radios = channelRadios[it->second];
+        radios.erase(std::remove(radios.begin(), radios.end(), radio), radios.end());
+        if (radios.empty())
+            channelRadios.erase(it->second);
+        radioChannels.erase(it);
+    }
+}
+
+bool LoRaMedium::isSleepingEndNode(const IRadio *radio) const
+{
+    if (radioChannels.find(radio->getId()) == radioChannels.end())
+        return false;
+    IRadio::RadioMode radioMode = radio->getRadioMode();
+    return radioMode != IRadio::RADIO_MODE_RECEIVER && radioMode != IRadio::RADIO_MODE_TRANSCEIVER;
+}
+
+bool LoRaMedium::isPotentialReceiver(const IRadio *radio, const ITransmission *transmission) const
+{
+    // sleeping end nodes pick up the transmission in pickUpTransmissions when they wake up
+    if (skipSleepingReceivers && isSleepingEndNode(radio))
+        return false;
+    // end nodes on another channel were left out in addTransmission
+    auto it = radioChannels.find(radio->getId());
+    if (it != radioChannels.end() && it->second != check_and_cast<const LoRaTransmission *>(transmission)->getLoRaCF())
+        return false;
+    return RadioMedium::isPotentialReceiver(radio, transmission);
 }
 
 bool LoRaMedium::matchesMacAddressFilter(const IRadio *radio, const Packet *packet) const
@@ -52,14 +152,19 @@ bool LoRaMedium::matchesMacAddressFilter(const IRadio *radio, const Packet *pack
     if (address.isBroadcast() || address.isMulticast())
         return true;
 
-    cModule *host = getContainingNode(check_and_cast<const cModule *>(radio));
-    IInterfaceTable *interfaceTable = check_and_cast<IInterfaceTable *>(host->getSubmodule("interfaceTable"));
-    for (int i = 0; i < interfaceTable->getNumInterfaces(); i++) {
-        auto interface = interfaceTable->getInterface(i);
-        if (interface && interface->getMacAddress() == address)
-            return true;
+    auto it = radioMacAddresses.find(radio->getId());
+    if (it == radioMacAddresses.end()) {
+        cModule *host = getContainingNode(check_and_cast<const cModule *>(radio));
+        IInterfaceTable *interfaceTable = check_and_cast<IInterfaceTable *>(host->getSubmodule("interfaceTable"));
+        std::vector<MacAddress> addresses;
+        for (int i = 0; i < interfaceTable->getNumInterfaces(); i++) {
+            auto interface = interfaceTable->getInterface(i);
+            if (interface)
+                addresses.push_back(interface->getMacAddress());
+        }
+        it = radioMacAddresses.emplace(radio->getId(), addresses).first;
     }
-    return false;
+    return std::find(it->second.begin(), it->second.end(), address) != it->second.end();
 }
 
 
@@ -80,7 +185,6 @@ const IReceptionResult *LoRaMedium::getReceptionResult(const IRadio *radio, cons
             snirInd->setMaximumSnir(snir->getMax());
         }
         if (!pkt->findTag<ErrorRateInd>()) {
-            auto errorModel = dynamic_cast<IErrorModel *>(getSubmodule("errorModel"));
             const ISnir *snir = getSNIR(radio, transmission);
             auto errorRateInd = pkt->addTagIfAbsent<ErrorRateInd>(); // TODO: should be done  setPacketErrorRate(packetModel->getPER());
             errorRateInd->setPacketErrorRate(errorModel ? errorModel->computePacketErrorRate(snir, IRadioSignal::SIGNAL_PART_WHOLE) : 0.0);
@@ -94,30 +198,239 @@ const IReceptionResult *LoRaMedium::getReceptionResult(const IRadio *radio, cons
     return result;
 }
 
+Packet *LoRaMedium::receivePacket(const IRadio *radio, IWirelessSignal *signal)
+{
+    const ITransmission *transmission = signal->getTransmission();
+    const IListening *listening = communicationCache->getCachedListening(radio, transmission);
+    if (recordCommunicationLog) {
+        const IReception *reception = getReception(radio, transmission);
+        communicationLog.writeReception(radio, reception);
+    }
+    const IReceptionResult *result = getReceptionResult(radio, listening, transmission);
+    communicationCache->removeCachedReceptionResult(radio, transmission);
+    // the result is owned by this call now, so its packet is handed over
+    // instead of duplicated
+    auto loRaResult = dynamic_cast<const LoRaReceptionResult *>(result);
+    Packet *packet = loRaResult != nullptr ? const_cast<LoRaReceptionResult *>(loRaResult)->releasePacket() : result->getPacket()->dup();
+    delete result;
+    return packet;
+}
+
+void LoRaMedium::dropReception(const IRadio *radio, IWirelessSignal *signal)
+{
+    const ITransmission *transmission = signal->getTransmission();
+    if (recordCommunicationLog) {
+        const IReception *reception = getReception(radio, transmission);
+        communicationLog.writeReception(radio, reception);
+    }
+    // only cached if something already asked for it, there is nothing to compute
+    delete communicationCache->getCachedReceptionResult(radio, transmission);
+    communicationCache->removeCachedReceptionResult(radio, transmission);
+}
+
 void LoRaMedium::addTransmission(const IRadio *transmitterRadio, const ITransmission *transmission)
 {
     Enter_Method("addTransmission");
     transmissionCount++;
     communicationCache->addTransmission(transmission);
     simtime_t maxArrivalEndTime = transmission->getEndTime();
-    communicationCache->mapRadios([&] (const IRadio *receiverRadio) {
-        if (receiverRadio != nullptr && receiverRadio != transmitterRadio && receiverRadio->getReceiver() != nullptr) {
-            const IArrival *arrival = propagation->computeArrival(transmission, receiverRadio->getAntenna()->getMobility());
-            const IntervalTree::Interval *interval = new IntervalTree::Interval(arrival->getStartTime(), arrival->getEndTime(), (void *)transmission);
-            const LoRaTransmission *loRaTransmission = check_and_cast<const LoRaTransmission *>(transmission);
-            LoRaBandListening *loraListening = new LoRaBandListening(receiverRadio, arrival->getStartTime(), arrival->getEndTime(), arrival->getStartPosition(), arrival->getEndPosition(), loRaTransmission->getLoRaCF(), loRaTransmission->getLoRaBW(), loRaTransmission->getLoRaSF());
-            const simtime_t arrivalEndTime = arrival->getEndTime();
-            if (arrivalEndTime > maxArrivalEndTime)
-                maxArrivalEndTime = arrivalEndTime;
-            communicationCache->setCachedArrival(receiverRadio, transmission, arrival);
-            communicationCache->setCachedInterval(receiverRadio, transmission, interval);
-            communicationCache->setCachedListening(receiverRadio, transmission, loraListening);
+    const LoRaTransmission *loRaTransmission = check_and_cast<const LoRaTransmission *>(transmission);
+    // only gateways and the end nodes on the same channel can receive or be
+    // interfered by this transmission, other radios get no cache entries
+    auto isReceiver = [&] (const IRadio *receiverRadio) {
+        return receiverRadio != nullptr && receiverRadio != transmitterRadio && receiverRadio->getReceiver() != nullptr;
+    };
+    fanOutReceivers.clear();
+    for (auto receiverRadio : gatewayRadios)
+        if (isReceiver(receiverRadio))
+            fanOutReceivers.push_back(receiverRadio);
+    auto it = channelRadios.find(loRaTransmission->getLoRaCF());
+    if (it != channelRadios.end())
+        for (auto receiverRadio : it->second) {
+            if (!isReceiver(receiverRadio))
+                continue;
+            if (skipSleepingReceivers && isSleepingEndNode(receiverRadio)) {
+                skippedReceiverCount++;
+                continue;
+            }
+            fanOutReceivers.push_back(receiverRadio);
         }
-    });
+    int numReceivers = fanOutReceivers.size();
+    fanOutArrivals.resize(numReceivers);
+    if (numReceivers > 0) {
+        LoRaArenaBlock *block = createArenaBlock(numReceivers);
+        for (int i = 0; i < numReceivers; i++) {
+            const IArrival *arrival = addReceiver(fanOutReceivers[i], loRaTransmission, block);
+            fanOutArrivals[i] = arrival;
+            if (arrival->getEndTime() > maxArrivalEndTime)
+                maxArrivalEndTime = arrival->getEndTime();
+        }
+        block->release();
+    }
+    if (workerPool != nullptr && numReceivers >= parallelFanOutThreshold)
+        computeReceptionsInParallel(loRaTransmission);
     communicationCache->setCachedInterferenceEndTime(transmission, maxArrivalEndTime + mediumLimitCache->getMaxTransmissionDuration());
+    addInterferingTransmission(loRaTransmission, communicationCache->getCachedInterferenceEndTime(transmission));
     if (!removeNonInterferingTransmissionsTimer->isScheduled())
         scheduleAt(communicationCache->getCachedInterferenceEndTime(transmission), removeNonInterferingTransmissionsTimer);
     emit(signalAddedSignal, check_and_cast<const cObject *>(transmission));
 }
 
+void LoRaMedium::addInterferingTransmission(const LoRaTransmission *transmission, simtime_t interferenceEndTime)
+{
+    Hz centerFrequency = transmission->getLoRaCF();
+    Hz bandwidth = transmission->getLoRaBW();
+    auto it = std::find_if(channelTransmissions.begin(), channelTransmissions.end(), [&] (const ChannelTransmissions& channel) {
+        return channel.centerFrequency == centerFrequency && channel.bandwidth == bandwidth;
+    });
+    if (it == channelTransmissions.end())
+        it = channelTransmissions.insert(channelTransmissions.end(), {centerFrequency, bandwidth, {}});
+    // transmissions are added when they start, which keeps the start time order
+    it->transmissions.push_back({transmission, transmission->getStartTime(), interferenceEndTime});
+}
+
+void LoRaMedium::removeNonInterferingTransmissions()
+{
+    // same condition as in the communication cache, the entries are dropped
+    // before their transmissions are deleted
+    simtime_t now = simTime();
+    for (auto& channel : channelTransmissions) {
+        auto& transmissions = channel.transmissions;
+        transmissions.erase(std::remove_if(transmissions.begin(), transmissions.end(), [&] (const InterferingTransmission& entry) {
+            return entry.interferenceEndTime <= now;
+        }), transmissions.end());
+    }
+    RadioMedium::removeNonInterferingTransmissions();
+}
+
+std::vector<const IReception *> *LoRaMedium::computeChannelInterferingReceptions(const IRadio *receiverRadio, const IListening *listening, const ITransmission *transmission) const
+{
+    // gateways have entries for the transmissions on all channels, so only the
+    // channels overlapping the listening band are visited; the analog model
+    // still rejects partially overlapping bands
+    auto loRaListening = check_and_cast<const LoRaBandListening *>(listening);
+    Hz centerFrequency = loRaListening->getLoRaCF();
+    Hz bandwidth = loRaListening->getLoRaBW();
+    auto interferingReceptions = new std::vector<const IReception *>();
+    for (auto& channel : channelTransmissions) {
+        if (!(std::abs((channel.centerFrequency - centerFrequency).get()) < ((channel.bandwidth + bandwidth) / 2).get()))
+            continue;
+        for (auto& entry : channel.transmissions) {
+            // arrivals start no earlier than their transmissions
+            if (entry.startTime > listening->getEndTime())
+                break;
+            const ITransmission *interferingTransmission = entry.transmission;
+            if (interferingTransmission == transmission || communicationCache->getCachedArrival(receiverRadio, interferingTransmission) == nullptr)
+                continue;
+            if (isInterferingTransmission(interferingTransmission, listening))
+                interferingReceptions->push_back(getReception(receiverRadio, interferingTransmission));
+        }
+    }
+    return interferingReceptions;
+}
+
+const IInterference *LoRaMedium::computeInterference(const IRadio *receiverRadio, const IListening *listening) const
+{
+    interferenceComputationCount++;
+    const INoise *noise = backgroundNoise ? backgroundNoise->computeNoise(listening) : nullptr;
+    return new Interference(noise, computeChannelInterferingReceptions(receiverRadio, listening, nullptr));
+}
+
+const IInterference *LoRaMedium::computeInterference(const IRadio *receiverRadio, const IListening *listening, const ITransmission *transmission) const
+{
+    interferenceComputationCount++;
+    const INoise *noise = backgroundNoise ? backgroundNoise->computeNoise(listening) : nullptr;
+    return new Interference(noise, computeChannelInterferingReceptions(receiverRadio, listening, transmission));
+}
+
+void LoRaMedium::computeReceptionsInParallel(const LoRaTransmission *transmission)
+{
+    // the receptions are computed eagerly here instead of lazily on demand,
+    // which is only equivalent if no RNG stream and no kernel object is involved
+    auto loRaAnalogModel = dynamic_cast<const LoRaAnalogModel *>(analogModel);
+    if (loRaAnalogModel == nullptr || obstacleLoss != nullptr)
+        return;
+    const ILoRaShadowingPathLoss *shadowingPathLoss = loRaAnalogModel->getShadowingPathLoss();
+    if (shadowingPathLoss == nullptr || !shadowingPathLoss->isCounterBasedShadowing())
+        return;
+    int numReceivers = fanOutReceivers.size();
+    fanOutReceiverIds.resize(numReceivers);
+    fanOutShadowing.resize(numReceivers);
+    fanOutReceptions.resize(numReceivers);
+    for (int i = 0; i < numReceivers; i++)
+        fanOutReceiverIds[i] = fanOutReceivers[i]->getId();
+    shadowingPathLoss->computeShadowing(transmission->getId(), fanOutReceiverIds.data(), fanOutShadowing.data(), numReceivers);
+    workerPool->parallelFor(numReceivers, [&] (int i) {
+        fanOutReceptions[i] = loRaAnalogModel->computeReception(fanOutReceivers[i], transmission, fanOutArrivals[i], fanOutShadowing[i]);
+    });
+    // committed in receiver order, independent of the thread scheduling
+    for (int i = 0; i < numReceivers; i++) {
+        communicationCache->setCachedReception(fanOutReceivers[i], transmission, fanOutReceptions[i]);
+        receptionComputationCount++;
+    }
+    parallelReceptionCount += numReceivers;
+}
+
+LoRaArenaBlock *LoRaMedium::createArenaBlock(int numReceivers)
+{
+    size_t entrySize = LoRaArenaBlock::getAllocationSize(sizeof(LoRaArenaObject<Arrival>)) + LoRaArenaBlock::getAllocationSize(sizeof(LoRaArenaObject<LoRaBandListening>));
+    LoRaArenaBlock *block = LoRaArenaBlock::create(numReceivers * entrySize);
+    arenaBlockCount++;
+    arenaEntryCount += numReceivers;
+    arenaByteCount += block->getSize();
+    return block;
+}
+
+const IArrival *LoRaMedium::addReceiver(const IRadio *receiverRadio, const LoRaTransmission *transmission, LoRaArenaBlock *block)
+{
+    // the arrival and the listening live as long as the transmission stays in
+    // the communication cache, so they are packed into the transmission's block;
+    // the cache deletes them as usual and the block goes away with the last one
+    const IArrival *arrival = propagation->computeArrival(transmission, receiverRadio->getAntenna()->getMobility());
+    if (auto computedArrival = dynamic_cast<const Arrival *>(arrival)) {
+        arrival = new (block) LoRaArenaObject<Arrival>(*computedArrival);
+        delete computedArrival;
+    }
+    // the interval tree of the cache keeps its own intervals
+    const IntervalTree::Interval *interval = new IntervalTree::Interval(arrival->getStartTime(), arrival->getEndTime(), (void *)transmission);
+    LoRaBandListening *loraListening = new (block) LoRaArenaObject<LoRaBandListening>(receiverRadio, arrival->getStartTime(), arrival->getEndTime(), arrival->getStartPosition(), arrival->getEndPosition(), transmission->getLoRaCF(), transmission->getLoRaBW(), transmission->getLoRaSF());
+    communicationCache->setCachedArrival(receiverRadio, transmission, arrival);
+    communicationCache->setCachedInterval(receiverRadio, transmission, interval);
+    communicationCache->setCachedListening(receiverRadio, transmission, loraListening);
+    return arrival;
+}
+
+void LoRaMedium::pickUpTransmissions(const IRadio *receiverRadio)
+{
+    Enter_Method("pickUpTransmissions");
+    if (!skipSleepingReceivers || isSleepingEndNode(receiverRadio))
+        return;
+    auto it = radioChannels.find(receiverRadio->getId());
+    if (it == radioChannels.end())
+        return;
+    Hz centerFrequency = it->second;
+    // every transmission still in the interference window gets an entry, so
+    // that the ones which already started arriving count as interference
+    communicationCache->mapTransmissions([&] (const ITransmission *transmission) {
+        auto loRaTransmission = check_and_cast<const LoRaTransmission *>(transmission);
+        auto transmitterRadio = check_and_cast<const Radio *>(transmission->getTransmitter());
+        if (transmitterRadio == receiverRadio || loRaTransmission->getLoRaCF() != centerFrequency || communicationCache->getCachedArrival(receiverRadio, transmission) != nullptr)
+            return;
+        LoRaArenaBlock *block = createArenaBlock(1);
+        const IArrival *arrival = addReceiver(receiverRadio, loRaTransmission, block);
+        block->release();
+        // a radio only attempts receptions whose preamble starts while it is listening
+        if (arrival->getStartTime() >= simTime() && isPotentialReceiver(receiverRadio, transmission)) {
+            cMethodCallContextSwitcher contextSwitcher(const_cast<Radio *>(transmitterRadio));
+            contextSwitcher.methodCallSilent();
+            auto signal = static_cast<WirelessSignal *>(createReceiverSignal(transmission));
+            cGate *gate = receiverRadio->getRadioGate()->getPathStartGate();
+            const_cast<Radio *>(transmitterRadio)->sendDirect(signal, arrival->getStartTime() - simTime(), transmission->getDuration(), gate);
+            communicationCache->setCachedSignal(receiverRadio, transmission, signal);
+            signalSendCount++;
+            pickedUpSignalCount++;
+        }
+    });
+}
+
 }
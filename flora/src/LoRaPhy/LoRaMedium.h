@@ -17,6 +17,9 @@
 #include "inet/physicallayer/wireless/common/medium/RadioMedium.h"
 #include "LoRa/LoRaRadio.h"
 #include "../LoRa/LoRaMacFrame_m.h"
+#include "LoRaArena.h"
+#include "LoRaTransmission.h"
+#include "LoRaWorkerPool.h"
 
 #include "inet/common/IntervalTree.h"
 #include "inet/environment/contract/IMaterialRegistry.h"
@@ -25,10 +28,15 @@
 #include "inet/physicallayer/wireless/common/medium/CommunicationLog.h"
 #include "inet/physicallayer/wireless/common/radio/packetlevel/Radio.h"
 #include "inet/physicallayer/wireless/common/contract/packetlevel/ICommunicationCache.h"
+#include "inet/physicallayer/wireless/common/contract/packetlevel/IErrorModel.h"
 #include "inet/physicallayer/wireless/common/contract/packetlevel/IMediumLimitCache.h"
 #include "inet/physicallayer/wireless/common/contract/packetlevel/INeighborCache.h"
 #include "inet/physicallayer/wireless/common/contract/packetlevel/IRadioMedium.h"
 #include <algorithm>
+#include <deque>
+#include <functional>
+#include <map>
+#include <unordered_map>
 
 namespace flora {
 class LoRaMedium : public RadioMedium
@@ -37,14 +45,115 @@ class LoRaMedium : public RadioMedium
     friend class LoRaRadio;
 
 protected:
+    /** @name Channel registries limiting the receivers a transmission is fanned out to */
+    //@{
+    /** End node radios by the center frequency they listen on. */
+    std::map<Hz, std::vector<const IRadio *>> channelRadios;
+    /** Center frequency each end node radio is registered under. */
+    std::unordered_map<int, Hz> radioChannels;
+    /** Gateway radios receive on every channel. */
+    std::vector<const IRadio *> gatewayRadios;
+    //@}
+
+    /** @name Lazy reception materialization for sleeping end nodes */
+    //@{
+    /** End nodes outside receiver mode get no cache entries and no signals until they wake up. */
+    bool skipSleepingReceivers = false;
+    long skippedReceiverCount = 0;
+    long pickedUpSignalCount = 0;
+    //@}
+
+    /** @name Parallel reception computation */
+    //@{
+    LoRaWorkerPool *workerPool = nullptr;
+    int parallelFanOutThreshold = 0;
+    long parallelReceptionCount = 0;
+    /** Per-receiver slots of the transmission being added, reused between transmissions. */
+    std::vector<const IRadio *> fanOutReceivers;
+    std::vector<const IArrival *> fanOutArrivals;
+    std::vector<int> fanOutReceiverIds;
+    std::vector<double> fanOutShadowing;
+    std::vector<const IReception *> fanOutReceptions;
+    //@}
+
+    /** @name Interference index partitioned by channel */
+    //@{
+    struct InterferingTransmission {
+        const ITransmission *transmission;
+        simtime_t startTime;
+        simtime_t interferenceEndTime;
+    };
+    struct ChannelTransmissions {
+        Hz centerFrequency;
+        Hz bandwidth;
+        /** Transmissions in the interference window, in start time order. */
+        std::deque<InterferingTransmission> transmissions;
+    };
+    /** One entry per channel seen so far, a channel plan has only a handful of them. */
+    std::vector<ChannelTransmissions> channelTransmissions;
+    //@}
+
+    /** @name Per transmission arenas of the arrivals and listenings in the communication cache */
+    //@{
+    long arenaBlockCount = 0;
+    long arenaEntryCount = 0;
+    long arenaByteCount = 0;
+    //@}
+
+    /** @name Module references resolved once instead of per packet */
+    //@{
+    IErrorModel *errorModel = nullptr;
+    /**
+     * MAC addresses of the interfaces on each radio's host, keyed on the
+     * radio id. Filled on the first packet, when all interfaces are configured.
+     */
+    mutable std::unordered_map<int, std::vector<MacAddress>> radioMacAddresses;
+    //@}
+
+protected:
+    virtual void initialize(int stage) override;
+    virtual void finish() override;
+    virtual bool isSleepingEndNode(const IRadio *radio) const;
+    virtual void addInterferingTransmission(const LoRaTransmission *transmission, simtime_t interferenceEndTime);
+    virtual void removeNonInterferingTransmissions() override;
+    /**
+     * Receptions of the transmissions on the channels overlapping the band of
+     * the listening that arrive at the receiver during the listening.
+     */
+    virtual std::vector<const IReception *> *computeChannelInterferingReceptions(const IRadio *receiver, const IListening *listening, const ITransmission *transmission) const;
+    virtual const IInterference *computeInterference(const IRadio *receiver, const IListening *listening) const override;
+    virtual const IInterference *computeInterference(const IRadio *receiver, const IListening *listening, const ITransmission *transmission) const override;
+    virtual LoRaArenaBlock *createArenaBlock(int numReceivers);
+    virtual const IArrival *addReceiver(const IRadio *receiverRadio, const LoRaTransmission *transmission, LoRaArenaBlock *block);
+    virtual void computeReceptionsInParallel(const LoRaTransmission *transmission);
     virtual bool matchesMacAddressFilter(const IRadio *radio, const Packet *packet) const override;
+    virtual bool isPotentialReceiver(const IRadio *receiver, const ITransmission *transmission) const override;
+    virtual void registerRadio(const IRadio *radio);
+    virtual void unregisterRadio(const IRadio *radio);
         //@}
     public:
       LoRaMedium();
       virtual ~LoRaMedium();
+      virtual void addRadio(const IRadio *radio) override;
+      virtual void removeRadio(const IRadio *radio) override;
+      /** Must be called when the center frequency of a registered radio changes. */
+      virtual void updateRadioChannel(const IRadio *radio);
+      /**
+       * Must be called when a radio enters receiver mode. With skipSleepingReceivers
+       * it creates the missing cache entries for the transmissions on the radio's
+       * channel and sends it the signals that have not started arriving yet.
+       */
+      virtual void pickUpTransmissions(const IRadio *radio);
       //virtual const IReceptionDecision *getReceptionDecision(const IRadio *receiver, const IListening *listening, const ITransmission *transmission, IRadioSignal::SignalPart part) const override;
       virtual const IReceptionResult *getReceptionResult(const IRadio *receiver, const IListening *listening, const ITransmission *transmission) const override;
+      virtual Packet *receivePacket(const IRadio *receiver, IWirelessSignal *signal) override;
+      /**
+       * Bookkeeping of receivePacket for a failed reception whose packet is not
+       * needed: logs the reception and frees its cached reception result.
+       */
+      virtual void dropReception(const IRadio *receiver, IWirelessSignal *signal);
       virtual void addTransmission(const IRadio *transmitter, const ITransmission *transmission);
+      virtual void mapRadios(std::function<void (const IRadio *)> f) const { communicationCache->mapRadios(f); }
 };
 }
 #endif /* LORAPHY_LORAMEDIUM_H_ */
@@ -112,8 +112,17 @@ std::ostream& LoRaMediumCache::printToStream(std::ostream &stream, int level, in
     return stream;
 }
 
+static bool isSameLimit(double a, double b)
+{
+    return a == b || (std::isnan(a) && std::isnan(b));
+}
+
 void LoRaMediumCache::updateLimits()
 {
+    limitsChanged = false;
+    W oldMaxTransmissionPower = maxTransmissionPower;
+    W oldMinInterferencePower = minInterferencePower;
+    double oldMaxAntennaGain = maxAntennaGain;
     minConstraintArea = computeMinConstraintArea();
     maxConstraintArea = computeMaxConstreaintArea();
     maxSpeed = computeMaxSpeed();
@@ -123,70 +132,86 @@ void LoRaMediumCache::updateLimits()
     maxAntennaGain = computeMaxAntennaGain();
     minInterferenceTime = computeMinInterferenceTime();
     maxTransmissionDuration = computeMaxTransmissionDuration();
-    maxCommunicationRange = getMaxCommunicationRange();
-    maxInterferenceRange = computeMaxInterferenceRange();
+    // the path loss range search only depends on these
+    if (!isSameLimit(maxTransmissionPower.get(), oldMaxTransmissionPower.get()) || !isSameLimit(minInterferencePower.get(), oldMinInterferencePower.get())
+            || !isSameLimit(maxAntennaGain, oldMaxAntennaGain) || !rangesComputed)
+    {
+        maxInterferenceRange = computeMaxInterferenceRange();
+        rangesComputed = true;
+    }
+}
+
+void LoRaMediumCache::updateRadioLimits(const RadioLimits& limits, bool add)
+{
+    auto update = [&] (LimitValues& values, double value) {
+        if (add)
+            values.add(value);
+        else
+            values.remove(value);
+    };
+    update(speeds, limits.maxSpeed);
+    update(transmissionPowers, limits.maxTransmissionPower);
+    update(interferencePowers, limits.minInterferencePower);
+    update(receptionPowers, limits.minReceptionPower);
+    update(antennaGains, limits.maxAntennaGain);
+    update(constraintAreaMins[0], limits.constraintAreaMin.x);
+    update(constraintAreaMins[1], limits.constraintAreaMin.y);
+    update(constraintAreaMins[2], limits.constraintAreaMin.z);
+    update(constraintAreaMaxs[0], limits.constraintAreaMax.x);
+    update(constraintAreaMaxs[1], limits.constraintAreaMax.y);
+    update(constraintAreaMaxs[2], limits.constraintAreaMax.z);
+    limitsChanged = true;
 }
 
 void LoRaMediumCache::addRadio(const IRadio *radio)
 {
-    radios.push_back(radio);
-    updateLimits();
+    if (radio == nullptr || radioLimits.find(radio) != radioLimits.end())
+        return;
+    const IMobility *mobility = radio->getAntenna()->getMobility();
+    RadioLimits limits;
+    limits.maxSpeed = mobility->getMaxSpeed();
+    limits.maxTransmissionPower = radio->getTransmitter()->getMaxPower().get();
+    limits.minInterferencePower = radio->getReceiver()->getMinInterferencePower().get();
+    limits.minReceptionPower = radio->getReceiver()->getMinReceptionPower().get();
+    limits.maxAntennaGain = radio->getAntenna()->getGain()->getMaxGain();
+    limits.constraintAreaMin = mobility->getConstraintAreaMin();
+    limits.constraintAreaMax = mobility->getConstraintAreaMax();
+    radioLimits[radio] = limits;
+    updateRadioLimits(limits, true);
 }
 
 void LoRaMediumCache::removeRadio(const IRadio *radio)
 {
-    radios.erase(std::remove(radios.begin(), radios.end(), radio), radios.end());
-    updateLimits();
+    auto it = radioLimits.find(radio);
+    if (it == radioLimits.end())
+        return;
+    updateRadioLimits(it->second, false);
+    radioLimits.erase(it);
 }
 
 mps LoRaMediumCache::computeMaxSpeed() const
 {
-    mps maxSpeed = mps(par("maxSpeed"));
-    for (const auto radio : radios) {
-        if (radio != nullptr)
-            maxSpeed = maxIgnoreNaN(maxSpeed, mps(radio->getAntenna()->getMobility()->getMaxSpeed()));
-    }
-    return maxSpeed;
+    return maxIgnoreNaN(mps(par("maxSpeed")), mps(speeds.getMax()));
 }
 
 W LoRaMediumCache::computeMaxTransmissionPower() const
 {
-    W maxTransmissionPower = W(par("maxTransmissionPower"));
-    for (const auto radio : radios) {
-        if (radio != nullptr)
-            maxTransmissionPower = maxIgnoreNaN(maxTransmissionPower, radio->getTransmitter()->getMaxPower());
-    }
-    return maxTransmissionPower;
+    return maxIgnoreNaN(W(par("maxTransmissionPower")), W(transmissionPowers.getMax()));
 }
 
 W LoRaMediumCache::computeMinInterferencePower() const
 {
-    W minInterferencePower = mW(math::dBmW2mW(par("minInterferencePower")));
-    for (const auto radio : radios) {
-        if (radio != nullptr)
-            minInterferencePower = minIgnoreNaN(minInterferencePower, radio->getReceiver()->getMinInterferencePower());
-    }
-    return minInterferencePower;
+    return minIgnoreNaN(W(mW(math::dBmW2mW(par("minInterferencePower")))), W(interferencePowers.getMin()));
 }
 
 W LoRaMediumCache::computeMinReceptionPower() const
 {
-    W minReceptionPower = mW(math::dBmW2mW(par("minReceptionPower")));
-    for (const auto radio : radios) {
-        if (radio != nullptr)
-            minReceptionPower = minIgnoreNaN(minReceptionPower, radio->getReceiver()->getMinReceptionPower());
-    }
-    return minReceptionPower;
+    return minIgnoreNaN(W(mW(math::dBmW2mW(par("minReceptionPower")))), W(receptionPowers.getMin()));
 }
 
 double LoRaMediumCache::computeMaxAntennaGain() const
 {
-    double maxAntennaGain = math::dB2fraction(par("maxAntennaGain"));
-    for (const auto radio : radios) {
-        if (radio != nullptr)
-            maxAntennaGain = maxIgnoreNaN(maxAntennaGain, radio->getAntenna()->getGain()->getMaxGain());
-    }
-    return maxAntennaGain;
+    return maxIgnoreNaN(math::dB2fraction(par("maxAntennaGain")), antennaGains.getMax());
 }
 
 m LoRaMediumCache::computeMaxRange(W maxTransmissionPower, W minReceptionPower) const
@@ -214,30 +239,17 @@ const simtime_t LoRaMediumCache::computeMaxTransmissionDuration() const
 
 Coord LoRaMediumCache::computeMinConstraintArea() const
 {
-    Coord minConstraintArea = Coord::NIL;
-    for (const auto radio : radios) {
-        if (radio != nullptr) {
-            const IMobility *mobility = radio->getAntenna()->getMobility();
-            minConstraintArea = minConstraintArea.min(mobility->getConstraintAreaMin());
-        }
-    }
-    return minConstraintArea;
+    return Coord(constraintAreaMins[0].getMin(), constraintAreaMins[1].getMin(), constraintAreaMins[2].getMin());
 }
 
 Coord LoRaMediumCache::computeMaxConstreaintArea() const
 {
-    Coord maxConstraintArea = Coord::NIL;
-    for (const auto radio : radios) {
-        if (radio != nullptr) {
-            const IMobility *mobility = radio->getAntenna()->getMobility();
-            maxConstraintArea = maxConstraintArea.max(mobility->getConstraintAreaMax());
-        }
-    }
-    return maxConstraintArea;
+    return Coord(constraintAreaMaxs[0].getMax(), constraintAreaMaxs[1].getMax(), constraintAreaMaxs[2].getMax());
 }
 
 m LoRaMediumCache::getMaxInterferenceRange(const IRadio* radio) const
 {
+    ensureLimits();
     m maxInterferenceRange = computeMaxRange(radio->getTransmitter()->getMaxPower(), minInterferencePower);
     if (!std::isnan(maxInterferenceRange.get()))
         return maxInterferenceRange;
@@ -246,6 +258,7 @@ m LoRaMediumCache::getMaxInterferenceRange(const IRadio* radio) const
 
 m LoRaMediumCache::getMaxCommunicationRange(const IRadio* radio) const
 {
+    ensureLimits();
     if (strcmp(radioMedium->par("pathLossType").stringValue(), "LoRaLogNormalShadowing") == 0) {
         LoRaLogNormalShadowing *loraLogNormalShadowing;
         loraLogNormalShadowing = check_and_cast<LoRaLogNormalShadowing *>(radioMedium->getSubmodule("pathLoss"));
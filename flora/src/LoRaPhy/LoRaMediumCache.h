@@ -21,6 +21,8 @@
 #include "inet/physicallayer/wireless/common/contract/packetlevel/IRadioMedium.h"
 #include "inet/physicallayer/wireless/common/contract/packetlevel/IMediumLimitCache.h"
 #include "LoRaPhy/LoRaMedium.h"
+#include <set>
+#include <unordered_map>
 
 namespace flora {
 
@@ -33,9 +35,58 @@ class LoRaMediumCache : public cModule, public IMediumLimitCache
     const LoRaMedium *radioMedium;
 
     /**
-     * The list of communicating radios on the medium.
+     * The non-NaN values the radios contribute to one limit, so that the
+     * minimum and maximum survive the removal of a radio.
      */
-    std::vector<const IRadio *> radios;
+    class LimitValues {
+      protected:
+        std::multiset<double> values;
+      public:
+        void add(double value) { if (!std::isnan(value)) values.insert(value); }
+        void remove(double value) {
+            if (!std::isnan(value)) {
+                auto it = values.find(value);
+                if (it != values.end())
+                    values.erase(it);
+            }
+        }
+        double getMin() const { return values.empty() ? NaN : *values.begin(); }
+        double getMax() const { return values.empty() ? NaN : *values.rbegin(); }
+    };
+
+    /** The values a radio contributed when it was added. */
+    struct RadioLimits {
+        double maxSpeed;
+        double maxTransmissionPower;
+        double minInterferencePower;
+        double minReceptionPower;
+        double maxAntennaGain;
+        Coord constraintAreaMin;
+        Coord constraintAreaMax;
+    };
+
+    /**
+     * The communicating radios on the medium.
+     */
+    std::unordered_map<const IRadio *, RadioLimits> radioLimits;
+
+    /** @name Limit values of the radios */
+    //@{
+    LimitValues speeds;
+    LimitValues transmissionPowers;   // W
+    LimitValues interferencePowers;   // W
+    LimitValues receptionPowers;      // W
+    LimitValues antennaGains;
+    LimitValues constraintAreaMins[3]; // x, y, z
+    LimitValues constraintAreaMaxs[3];
+    //@}
+
+    /**
+     * Set when a radio was added or removed. The limits are updated on the
+     * next query, i.e. once after all radios are added during initialization.
+     */
+    bool limitsChanged = true;
+    bool rangesComputed = false;
 
     /** @name Various radio medium limits. */
     /**
@@ -121,6 +172,8 @@ class LoRaMediumCache : public cModule, public IMediumLimitCache
     virtual m computeMaxInterferenceRange() const;
 
     virtual void updateLimits();
+    virtual void updateRadioLimits(const RadioLimits& limits, bool add);
+    void ensureLimits() const { if (limitsChanged) const_cast<LoRaMediumCache *>(this)->updateLimits(); }
     //@}
 
   public:
@@ -133,22 +186,22 @@ class LoRaMediumCache : public cModule, public IMediumLimitCache
 
     /** @name Query limits */
     //@{
-    virtual Coord getMinConstraintArea() const override { return minConstraintArea; }
-    virtual Coord getMaxConstraintArea() const override { return maxConstraintArea; }
+    virtual Coord getMinConstraintArea() const override { ensureLimits(); return minConstraintArea; }
+    virtual Coord getMaxConstraintArea() const override { ensureLimits(); return maxConstraintArea; }
 
-    virtual mps getMaxSpeed() const override { return maxSpeed; }
+    virtual mps getMaxSpeed() const override { ensureLimits(); return maxSpeed; }
 
-    virtual W getMaxTransmissionPower() const override { return maxTransmissionPower; }
-    virtual W getMinInterferencePower() const override { return minInterferencePower; }
-    virtual W getMinReceptionPower() const override { return minReceptionPower; }
+    virtual W getMaxTransmissionPower() const override { ensureLimits(); return maxTransmissionPower; }
+    virtual W getMinInterferencePower() const override { ensureLimits(); return minInterferencePower; }
+    virtual W getMinReceptionPower() const override { ensureLimits(); return minReceptionPower; }
 
-    virtual double getMaxAntennaGain() const override { return maxAntennaGain; }
+    virtual double getMaxAntennaGain() const override { ensureLimits(); return maxAntennaGain; }
 
-    virtual const simtime_t& getMinInterferenceTime() const override { return minInterferenceTime; }
-    virtual const simtime_t& getMaxTransmissionDuration() const override { return maxTransmissionDuration; }
+    virtual const simtime_t& getMinInterferenceTime() const override { ensureLimits(); return minInterferenceTime; }
+    virtual const simtime_t& getMaxTransmissionDuration() const override { ensureLimits(); return maxTransmissionDuration; }
 
-    virtual m getMaxCommunicationRange() const override { return maxCommunicationRange; }
-    virtual m getMaxInterferenceRange() const override { return maxInterferenceRange; }
+    virtual m getMaxCommunicationRange() const override { ensureLimits(); return maxCommunicationRange; }
+    virtual m getMaxInterferenceRange() const override { ensureLimits(); return maxInterferenceRange; }
 
     virtual m getMaxCommunicationRange(const IRadio *radio) const override;
     virtual m getMaxInterferenceRange(const IRadio *radio) const override;
@@ -17,6 +17,7 @@
 
 #include "LoRaPhy/LoRaNeighborCache.h"
 #include "inet/common/ModuleAccess.h"
+#include <algorithm>
 
 namespace flora {
 
@@ -24,9 +25,10 @@ Define_Module(LoRaNeighborCache);
 
 LoRaNeighborCache::LoRaNeighborCache() :
     radioMedium(nullptr),
-    updateNeighborListsTimer(nullptr),
+    updateCellsTimer(nullptr),
     refillPeriod(NaN),
     range(NaN),
+    cellSize(NaN),
     maxSpeed(NaN)
 {
 }
@@ -37,13 +39,16 @@ void LoRaNeighborCache::initialize(int stage)
         radioMedium = getModuleFromPar<LoRaMedium>(par("radioMediumModule"), this);
         refillPeriod = par("refillPeriod");
         range = par("range");
-        updateNeighborListsTimer = new cMessage("updateNeighborListsTimer");
+        cellSize = range;
+        if (!(cellSize > 0))
+            throw cRuntimeError("The neighbor cache range must be positive");
+        updateCellsTimer = new cMessage("updateCellsTimer");
     }
     else if (stage == INITSTAGE_PHYSICAL_LAYER_NEIGHBOR_CACHE) {
         maxSpeed = radioMedium->getMediumLimitCache()->getMaxSpeed().get();
-        updateNeighborLists();
+        updateCells();
         if (maxSpeed != 0)
-            scheduleAt(simTime() + refillPeriod, updateNeighborListsTimer);
+            scheduleAt(simTime() + refillPeriod, updateCellsTimer);
     }
 }
 
@@ -53,13 +58,14 @@ std::ostream& LoRaNeighborCache::printToStream(std::ostream& stream, int level,
     if (level <= PRINT_LEVEL_TRACE)
         stream << ", refillPeriod = " << refillPeriod
                << ", range = " << range
-               << ", maxSpeed = " << maxSpeed;
+               << ", maxSpeed = " << maxSpeed
+               << ", numCells = " << cells.size();
     return stream;
 }
 
 void LoRaNeighborCache::sendToNeighbors(IRadio *transmitter, const IWirelessSignal *frame, double range) const
 {
-    EV << "LoRaMedium->LoRaNeighborCache sendToNeighbors" << endl;
+    EV_TRACE << "LoRaMedium->LoRaNeighborCache sendToNeighbors" << endl;
     if (this->range < range)
         throw cRuntimeError("The transmitter's (id: %d) range is bigger then the cache range", transmitter->getId());
 
@@ -67,11 +73,25 @@ void LoRaNeighborCache::sendToNeighbors(IRadio *transmitter, const IWirelessSign
     if (it == radioToEntry.end())
         throw cRuntimeError("Transmitter is not found");
 
-    RadioEntry *radioEntry = it->second;
-    Radios& neighborVector = radioEntry->neighborVector;
-
-    for (auto & elem : neighborVector)
-        radioMedium->sendToRadio(transmitter, elem, frame);
+    const RadioEntry *transmitterEntry = it->second;
+    const Coord& transmitterPosition = transmitterEntry->position;
+    double radius = maxSpeed * refillPeriod + this->range;
+    double sqrRadius = radius * radius;
+    int span = (int)std::ceil(radius / cellSize);
+    int cellX = getCellIndex(transmitterPosition.x);
+    int cellY = getCellIndex(transmitterPosition.y);
+
+    for (int x = cellX - span; x <= cellX + span; x++) {
+        for (int y = cellY - span; y <= cellY + span; y++) {
+            auto jt = cells.find(getCellKey(x, y));
+            if (jt == cells.end())
+                continue;
+            for (auto elem : jt->second) {
+                if (elem != transmitterEntry && elem->position.sqrdist(transmitterPosition) <= sqrRadius)
+                    radioMedium->sendToRadio(transmitter, elem->radio, frame);
+            }
+        }
+    }
 }
 
 void LoRaNeighborCache::handleMessage(cMessage *msg)
@@ -79,70 +99,73 @@ void LoRaNeighborCache::handleMessage(cMessage *msg)
     if (!msg->isSelfMessage())
         throw cRuntimeError("This module only handles self messages");
 
-    updateNeighborLists();
+    updateCells();
 
     scheduleAt(simTime() + refillPeriod, msg);
 }
 
-void LoRaNeighborCache::updateNeighborList(RadioEntry *radioEntry)
+void LoRaNeighborCache::insertIntoCell(RadioEntry *radioEntry)
 {
-    IMobility *radioMobility = radioEntry->radio->getAntenna()->getMobility();
-    Coord radioPosition = radioMobility->getCurrentPosition();
-    double radius = maxSpeed * refillPeriod + range;
-    radioEntry->neighborVector.clear();
-
-    for (auto & elem : radios) {
-        const IRadio *otherRadio = elem->radio;
-        Coord otherEntryPosition = otherRadio->getAntenna()->getMobility()->getCurrentPosition();
-
-        if (otherRadio->getId() != radioEntry->radio->getId() &&
-            otherEntryPosition.sqrdist(radioPosition) <= radius * radius)
-            radioEntry->neighborVector.push_back(otherRadio);
+    radioEntry->cellKey = getCellKey(getCellIndex(radioEntry->position.x), getCellIndex(radioEntry->position.y));
+    cells[radioEntry->cellKey].push_back(radioEntry);
+}
+
+void LoRaNeighborCache::removeFromCell(RadioEntry *radioEntry)
+{
+    auto it = cells.find(radioEntry->cellKey);
+    if (it == cells.end())
+        return;
+    RadioEntries& cell = it->second;
+    cell.erase(std::remove(cell.begin(), cell.end(), radioEntry), cell.end());
+    if (cell.empty())
+        cells.erase(it);
+}
+
+void LoRaNeighborCache::updateCell(RadioEntry *radioEntry)
+{
+    Coord position = radioEntry->radio->getAntenna()->getMobility()->getCurrentPosition();
+    int64_t cellKey = getCellKey(getCellIndex(position.x), getCellIndex(position.y));
+    if (cellKey != radioEntry->cellKey) {
+        removeFromCell(radioEntry);
+        radioEntry->position = position;
+        insertIntoCell(radioEntry);
     }
+    else
+        radioEntry->position = position;
+}
 
+void LoRaNeighborCache::updateCells()
+{
+    EV_DETAIL << "Updating the neighbor cells" << endl;
+    for (auto & elem : radios)
+        updateCell(elem);
 }
 
 void LoRaNeighborCache::addRadio(const IRadio *radio)
 {
     RadioEntry *newEntry = new RadioEntry(radio);
+    newEntry->position = radio->getAntenna()->getMobility()->getCurrentPosition();
+    insertIntoCell(newEntry);
     radios.push_back(newEntry);
     radioToEntry[radio] = newEntry;
-    updateNeighborLists();
     maxSpeed = radioMedium->getMediumLimitCache()->getMaxSpeed().get();
-    if (maxSpeed != 0 && !updateNeighborListsTimer->isScheduled() && initialized())
-        scheduleAt(simTime() + refillPeriod, updateNeighborListsTimer);
+    if (maxSpeed != 0 && !updateCellsTimer->isScheduled() && initialized())
+        scheduleAt(simTime() + refillPeriod, updateCellsTimer);
 }
 
 void LoRaNeighborCache::removeRadio(const IRadio *radio)
 {
-    auto it = find(radios.begin(), radios.end(), radioToEntry[radio]);
-    if (it != radios.end()) {
-        removeRadioFromNeighborLists(radio);
-        radios.erase(it);
-        maxSpeed = radioMedium->getMediumLimitCache()->getMaxSpeed().get();
-        if (maxSpeed == 0 && initialized())
-            cancelEvent(updateNeighborListsTimer);
-    }
-    else {
+    auto it = radioToEntry.find(radio);
+    if (it == radioToEntry.end())
         throw cRuntimeError("You can't remove radio: %d because it is not in our radio vector", radio->getId());
-    }
-}
-
-void LoRaNeighborCache::updateNeighborLists()
-{
-    EV_DETAIL << "Updating the neighbor lists" << endl;
-    for (auto & elem : radios)
-        updateNeighborList(elem);
-}
-
-void LoRaNeighborCache::removeRadioFromNeighborLists(const IRadio *radio)
-{
-    for (auto & elem : radios) {
-        Radios neighborVector = elem->neighborVector;
-        auto it = find(neighborVector.begin(), neighborVector.end(), radio);
-        if (it != neighborVector.end())
-            neighborVector.erase(it);
-    }
+    RadioEntry *radioEntry = it->second;
+    removeFromCell(radioEntry);
+    radios.erase(std::remove(radios.begin(), radios.end(), radioEntry), radios.end());
+    radioToEntry.erase(it);
+    delete radioEntry;
+    maxSpeed = radioMedium->getMediumLimitCache()->getMaxSpeed().get();
+    if (maxSpeed == 0 && initialized())
+        cancelEvent(updateCellsTimer);
 }
 
 LoRaNeighborCache::~LoRaNeighborCache()
@@ -150,7 +173,7 @@ LoRaNeighborCache::~LoRaNeighborCache()
     for (auto & elem : radios)
         delete elem;
 
-    cancelAndDelete(updateNeighborListsTimer);
+    cancelAndDelete(updateCellsTimer);
 }
 
 } // namespace inet
@@ -19,11 +19,17 @@
 
 #include "inet/physicallayer/wireless/common/medium/RadioMedium.h"
 #include "LoRaPhy/LoRaMedium.h"
-#include <set>
+#include <cmath>
+#include <unordered_map>
 #include <vector>
 
 namespace flora {
 
+/**
+ * Neighbor cache backed by a uniform grid. Every radio is binned into a
+ * square cell whose size equals the cache range, so a transmission only has
+ * to visit the cells around the transmitter instead of every radio.
+ */
 class LoRaNeighborCache : public cSimpleModule, public INeighborCache
 {
   public:
@@ -31,32 +37,35 @@ class LoRaNeighborCache : public cSimpleModule, public INeighborCache
     {
         RadioEntry(const IRadio *radio) : radio(radio) {};
         const IRadio *radio;
-        std::vector<const IRadio *> neighborVector;
-        bool operator==(RadioEntry *rhs) const
-        {
-            return this->radio->getId() == rhs->radio->getId();
-        }
+        Coord position;
+        int64_t cellKey = 0;
     };
     typedef std::vector<RadioEntry *> RadioEntries;
-    typedef std::vector<const IRadio *> Radios;
     typedef std::map<const IRadio *, RadioEntry *> RadioEntryCache;
+    typedef std::unordered_map<int64_t, RadioEntries> CellGrid;
 
   protected:
     LoRaMedium *radioMedium;
     RadioEntries radios;
-    cMessage *updateNeighborListsTimer;
+    CellGrid cells;
+    cMessage *updateCellsTimer;
     RadioEntryCache radioToEntry;
     double refillPeriod;
     double range;
+    double cellSize;
     double maxSpeed;
 
   protected:
     virtual int numInitStages() const override { return NUM_INIT_STAGES; }
     virtual void initialize(int stage) override;
     virtual void handleMessage(cMessage *msg) override;
-    void updateNeighborList(RadioEntry *radioEntry);
-    void updateNeighborLists();
-    void removeRadioFromNeighborLists(const IRadio *radio);
+
+    int getCellIndex(double coordinate) const { return (int)std::floor(coordinate / cellSize); }
+    int64_t getCellKey(int cellX, int cellY) const { return ((int64_t)cellX << 32) | (uint32_t)cellY; }
+    void insertIntoCell(RadioEntry *radioEntry);
+    void removeFromCell(RadioEntry *radioEntry);
+    void updateCell(RadioEntry *radioEntry);
+    void updateCells();
 
   public:
     LoRaNeighborCache();
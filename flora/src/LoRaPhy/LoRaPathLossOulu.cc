@@ -25,12 +25,11 @@ LoRaPathLossOulu::LoRaPathLossOulu()
 
 void LoRaPathLossOulu::initialize(int stage)
 {
-    FreeSpacePathLoss::initialize(stage);
+    LoRaShadowingPathLossBase::initialize(stage);
     if (stage == INITSTAGE_LOCAL) {
         d0 = m(par("d0"));
         n = par("n");
         B = par("B");
-        sigma = par("sigma");
         antennaGain = par("antennaGain");
     }
 }
@@ -44,4 +43,10 @@ double LoRaPathLossOulu::computePathLoss(mps propagationSpeed, Hz frequency, m d
     return math::dB2fraction(-PL_db);
 }
 
+double LoRaPathLossOulu::computeMeanPathLoss(mps propagationSpeed, Hz frequency, m distance) const
+{
+    double PL_db = B + 10 * n * log10(unit(distance/d0).get()) - antennaGain;
+    return math::dB2fraction(-PL_db);
+}
+
 }
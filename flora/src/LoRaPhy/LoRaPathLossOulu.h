@@ -16,7 +16,7 @@
 #ifndef LORAPHY_LORAPATHLOSSOULU_H_
 #define LORAPHY_LORAPATHLOSSOULU_H_
 
-#include "inet/physicallayer/wireless/common/pathloss/FreeSpacePathLoss.h"
+#include "LoRaPhy/LoRaShadowingPathLossBase.h"
 
 using namespace inet;
 using namespace inet::physicallayer;
@@ -25,13 +25,12 @@ namespace flora {
 /**
  * This class implements the log normal shadowing model.
  */
-class LoRaPathLossOulu : public FreeSpacePathLoss
+class LoRaPathLossOulu : public LoRaShadowingPathLossBase
 {
   protected:
     m d0;
     double n;
     double B;
-    double sigma;
     double antennaGain;
 
   protected:
@@ -40,6 +39,7 @@ class LoRaPathLossOulu : public FreeSpacePathLoss
   public:
     LoRaPathLossOulu();
     virtual double computePathLoss(mps propagationSpeed, Hz frequency, m distance) const override;
+    virtual double computeMeanPathLoss(mps propagationSpeed, Hz frequency, m distance) const override;
 };
 
 } // namespace inet
@@ -0,0 +1,82 @@
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see http://www.gnu.org/licenses/.
+//
+
+#ifndef LORAPHY_LORAPHYPARAMETERS_H_
+#define LORAPHY_LORAPHYPARAMETERS_H_
+
+#include "inet/common/Units.h"
+#include <cstdint>
+#include <sstream>
+#include <type_traits>
+
+using namespace inet;
+using namespace inet::units::values;
+namespace flora {
+
+/**
+ * The signal parameters of a LoRa frame. The application sets them once in
+ * the LoRaTag; the MAC frame, the PHY preamble and the transmission copy
+ * them as a whole.
+ */
+class LoRaPhyParameters
+{
+  protected:
+    double power = 0.1;                 // W
+    double centerFrequency = 922e6;     // Hz
+    double bandwidth = 125e3;           // Hz
+    int8_t spreadFactor = 12;
+    int8_t codeRendundance = 1;
+    bool useHeader = true;
+
+  public:
+    W getPower() const { return W(power); }
+    void setPower(W power) { this->power = power.get(); }
+    Hz getCenterFrequency() const { return Hz(centerFrequency); }
+    void setCenterFrequency(Hz centerFrequency) { this->centerFrequency = centerFrequency.get(); }
+    Hz getBandwidth() const { return Hz(bandwidth); }
+    void setBandwidth(Hz bandwidth) { this->bandwidth = bandwidth.get(); }
+    int getSpreadFactor() const { return spreadFactor; }
+    void setSpreadFactor(int spreadFactor) { this->spreadFactor = spreadFactor; }
+    int getCodeRendundance() const { return codeRendundance; }
+    void setCodeRendundance(int codeRendundance) { this->codeRendundance = codeRendundance; }
+    bool getUseHeader() const { return useHeader; }
+    void setUseHeader(bool useHeader) { this->useHeader = useHeader; }
+
+    bool operator==(const LoRaPhyParameters& other) const {
+        return power == other.power && centerFrequency == other.centerFrequency && bandwidth == other.bandwidth
+                && spreadFactor == other.spreadFactor && codeRendundance == other.codeRendundance && useHeader == other.useHeader;
+    }
+    bool operator!=(const LoRaPhyParameters& other) const { return !(*this == other); }
+
+    size_t hash() const {
+        size_t result = std::hash<double>()(centerFrequency);
+        result = result * 31 + std::hash<double>()(power);
+        result = result * 31 + std::hash<double>()(bandwidth);
+        return result * 31 + (spreadFactor << 16 | codeRendundance << 8 | useHeader);
+    }
+
+    std::string str() const {
+        std::ostringstream stream;
+        stream << "TP = " << getPower() << ", CF = " << getCenterFrequency() << ", SF = " << (int)spreadFactor
+               << ", BW = " << getBandwidth() << ", CR = " << (int)codeRendundance << ", header = " << useHeader;
+        return stream.str();
+    }
+};
+
+static_assert(std::is_trivially_copyable<LoRaPhyParameters>::value, "copied by value through all layers");
+
+} // namespace flora
+
+#endif /* LORAPHY_LORAPHYPARAMETERS_H_ */
@@ -0,0 +1,66 @@
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see http://www.gnu.org/licenses/.
+//
+
+#ifndef LORAPHY_LORAPHYPREAMBLECACHE_H_
+#define LORAPHY_LORAPHYPREAMBLECACHE_H_
+
+#include "LoRaPhy/LoRaPhyPreamble_m.h"
+#include <unordered_map>
+
+namespace flora {
+
+/**
+ * Interned PHY preamble chunks. Chunks are immutable once inserted into a
+ * packet, so all frames with the same signal parameters and receiver can
+ * share one, and a radio sending with fixed parameters allocates none in
+ * the steady state.
+ */
+class LoRaPhyPreambleCache
+{
+  protected:
+    struct Key {
+        LoRaPhyParameters phy;
+        MacAddress receiverAddress;
+        bool operator==(const Key& other) const { return phy == other.phy && receiverAddress == other.receiverAddress; }
+    };
+    struct KeyHash {
+        size_t operator()(const Key& key) const { return key.phy.hash() * 31 + std::hash<uint64_t>()(key.receiverAddress.getInt()); }
+    };
+
+    // bounds the cache of a gateway answering many nodes
+    static constexpr size_t MAX_SIZE = 4096;
+    std::unordered_map<Key, Ptr<const LoRaPhyPreamble>, KeyHash> preambles;
+
+  public:
+    Ptr<const LoRaPhyPreamble> getPreamble(const LoRaPhyParameters& phy, const MacAddress& receiverAddress) {
+        Key key = {phy, receiverAddress};
+        auto it = preambles.find(key);
+        if (it != preambles.end())
+            return it->second;
+        if (preambles.size() >= MAX_SIZE)
+            preambles.clear();
+        auto preamble = makeShared<LoRaPhyPreamble>();
+        preamble->setPhy(phy);
+        preamble->setReceiverAddress(receiverAddress);
+        preamble->setChunkLength(b(16));
+        preamble->markImmutable();
+        preambles[key] = preamble;
+        return preamble;
+    }
+};
+
+} // namespace flora
+
+#endif /* LORAPHY_LORAPHYPREAMBLECACHE_H_ */
@@ -15,6 +15,8 @@
 
 #include "LoRaReceiver.h"
 #include "LoRaReception.h"
+#include "LoRaReceptionResult.h"
+#include "LoRaAnalogModel.h"
 #include "inet/physicallayer/wireless/common/analogmodel/packetlevel/ScalarNoise.h"
 #include "../LoRaApp/SimpleLoRaApp.h"
 #include "LoRaPhyPreamble_m.h"
@@ -40,7 +42,15 @@ void LoRaReceiver::initialize(int stage)
         {
             iAmGateway = true;
         } else iAmGateway = false;
+        cModule *mac = getParentModule()->getParentModule()->getSubmodule("mac");
+        if (iAmGateway)
+            loRaGWMac = check_and_cast<LoRaGWMac *>(mac);
+        else {
+            loRaRadio = check_and_cast<LoRaRadio *>(getParentModule());
+            loRaMac = check_and_cast<LoRaMac *>(mac);
+        }
         alohaChannelModel = par("alohaChannelModel");
+        sensitivityTable.parse(par("sensitivityTable").xmlValue());
         LoRaReceptionCollision = registerSignal("LoRaReceptionCollision");
         numCollisions = 0;
         rcvBelowSensitivity = 0;
@@ -58,10 +68,6 @@ bool LoRaReceiver::computeIsReceptionPossible(const IListening *listening, const
 {
     //here we can check compatibility of LoRaTx parameters (or beeing a gateway)
     const LoRaTransmission *loRaTransmission = check_and_cast<const LoRaTransmission *>(transmission);
-//    auto *loRaApp = check_and_cast<SimpleLoRaApp *>(getParentModule()->getParentModule()->getSubmodule("SimpleLoRaApp"));
-    auto *loRaRadio = check_and_cast<LoRaRadio *>(getParentModule());
-//    auto node = getContainingNode(this);
-//    auto loRaRadio = check_and_cast<LoRaRadio *>(node->getSubmodule("LoRaNic")->getSubmodule("LoRaRadio"));
     if(iAmGateway || (loRaTransmission->getLoRaCF() == loRaRadio->loRaCF && loRaTransmission->getLoRaBW() == loRaRadio->loRaBW && loRaTransmission->getLoRaSF() == loRaRadio->loRaSF))
         return true;
     else
@@ -102,14 +108,12 @@ bool LoRaReceiver::computeIsReceptionAttempted(const IListening *listening, cons
             rec = loraMac->getReceiverAddress();
 
         if (iAmGateway == false) {
-            auto *macLayer = check_and_cast<LoRaMac *>(getParentModule()->getParentModule()->getSubmodule("mac"));
-            if (rec == macLayer->getAddress()) {
+            if (rec == loRaMac->getAddress()) {
                 const_cast<LoRaReceiver* >(this)->numCollisions++;
             }
             //EV << "Node: Extracted macFrame = " << loraMacFrame->getReceiverAddress() << ", node address = " << macLayer->getAddress() << std::endl;
         } else {
-            auto *gwMacLayer = check_and_cast<LoRaGWMac *>(getParentModule()->getParentModule()->getSubmodule("mac"));
-            EV << "GW: Extracted macFrame = " << rec << ", node address = " << gwMacLayer->getAddress() << std::endl;
+            EV_DEBUG << "GW: Extracted macFrame = " << rec << ", node address = " << loRaGWMac->getAddress() << std::endl;
             if (rec == MacAddress::BROADCAST_ADDRESS) {
                 const_cast<LoRaReceiver* >(this)->numCollisions++;
             }
@@ -128,80 +132,55 @@ bool LoRaReceiver::isPacketCollided(const IReception *reception, IRadioSignal::S
     const LoRaReception *loRaReception = check_and_cast<const LoRaReception *>(reception);
     simtime_t m_x = (loRaReception->getStartTime() + loRaReception->getEndTime())/2;
     simtime_t d_x = (loRaReception->getEndTime() - loRaReception->getStartTime())/2;
-    EV << "Czas transmisji to " << loRaReception->getEndTime() - loRaReception->getStartTime() << endl;
-    double P_threshold = 6;
     W signalRSSI_w = loRaReception->getPower();
     double signalRSSI_mw = signalRSSI_w.get()*1000;
     double signalRSSI_dBm = math::mW2dBmW(signalRSSI_mw);
-    EV << signalRSSI_mw << endl;
-    EV << signalRSSI_dBm << endl;
+    EV_TRACE << "Checking collisions of a " << 2 * d_x << " long reception with power " << signalRSSI_dBm << " dBm" << endl;
     int receptionSF = loRaReception->getLoRaSF();
+    Hz receptionCF = loRaReception->getLoRaCF();
+
+    /* If last 6 symbols of preamble are received, no collision*/
+    double nPreamble = 8; //from the paper "Do Lora networks..."
+    simtime_t Tsym = (pow(2, loRaReception->getLoRaSF()))/(loRaReception->getLoRaBW().get()/1000)/1000;
+    simtime_t csBegin = loRaReception->getPreambleStartTime() + Tsym * (nPreamble - 6);
+
+    // The tests are ordered from the cheapest to the most expensive one and
+    // the power of an interferer is only converted to dBm when it overlaps in
+    // time and frequency and hits the sensitive part of the preamble. The
+    // first destructive interferer ends the search.
     for (auto interferingReception : *interferingReceptions) {
-        bool overlap = false;
-        bool frequencyCollision = false;
-        bool captureEffect = false;
-        bool timingCollision = false; //Collision is acceptable in first part of preamble
         const LoRaReception *loRaInterference = check_and_cast<const LoRaReception *>(interferingReception);
+        if(receptionCF != loRaInterference->getLoRaCF())
+            continue;
 
         simtime_t m_y = (loRaInterference->getStartTime() + loRaInterference->getEndTime())/2;
         simtime_t d_y = (loRaInterference->getEndTime() - loRaInterference->getStartTime())/2;
-        if(omnetpp::fabs(m_x - m_y) < d_x + d_y)
-        {
-            overlap = true;
-        }
-
-        if(loRaReception->getLoRaCF() == loRaInterference->getLoRaCF())
-        {
-            frequencyCollision = true;
-        }
-
-        W interferenceRSSI_w = loRaInterference->getPower();
-        double interferenceRSSI_mw = interferenceRSSI_w.get()*1000;
-        double interferenceRSSI_dBm = math::mW2dBmW(interferenceRSSI_mw);
-        int interferenceSF = loRaInterference->getLoRaSF();
+        if(!(omnetpp::fabs(m_x - m_y) < d_x + d_y))
+            continue;
 
-        /* If difference in power between two signals is greater than threshold, no collision*/
-        if(signalRSSI_dBm - interferenceRSSI_dBm >= nonOrthDelta[receptionSF-7][interferenceSF-7])
+        if(alohaChannelModel == false)
         {
-            captureEffect = true;
+            bool timingCollision = csBegin < loRaInterference->getEndTime(); //Collision is acceptable in first part of preamble
+            if(!timingCollision)
+                continue;
+
+            W interferenceRSSI_w = loRaInterference->getPower();
+            double interferenceRSSI_mw = interferenceRSSI_w.get()*1000;
+            double interferenceRSSI_dBm = math::mW2dBmW(interferenceRSSI_mw);
+            int interferenceSF = loRaInterference->getLoRaSF();
+
+            /* If difference in power between two signals is greater than threshold, no collision*/
+            bool captureEffect = signalRSSI_dBm - interferenceRSSI_dBm >= nonOrthDelta[receptionSF-7][interferenceSF-7];
+
+            EV_TRACE << "Interferer at SF" << interferenceSF << " with power " << interferenceRSSI_dBm << " dBm against SF" << receptionSF
+                     << ", power difference " << signalRSSI_dBm - interferenceRSSI_dBm << " dB, acceptable " << nonOrthDelta[receptionSF-7][interferenceSF-7]
+                     << " dB -> packet is " << (captureEffect ? "not discarded" : "discarded") << endl;
+            if (captureEffect)
+                continue;
         }
 
-        EV << "[MSDEBUG] Received packet at SF: " << receptionSF << " with power " << signalRSSI_dBm << endl;
-        EV << "[MSDEBUG] Received interference at SF: " << interferenceSF << " with power " << interferenceRSSI_dBm << endl;
-        EV << "[MSDEBUG] Acceptable diff is equal " << nonOrthDelta[receptionSF-7][interferenceSF-7] << endl;
-        EV << "[MSDEBUG] Diff is equal " << signalRSSI_dBm - interferenceRSSI_dBm << endl;
-        if (captureEffect == false)
-        {
-            EV << "[MSDEBUG] Packet is discarded" << endl;
-        } else
-            EV << "[MSDEBUG] Packet is not discarded" << endl;
-
-        /* If last 6 symbols of preamble are received, no collision*/
-        double nPreamble = 8; //from the paper "Do Lora networks..."
-        simtime_t Tsym = (pow(2, loRaReception->getLoRaSF()))/(loRaReception->getLoRaBW().get()/1000)/1000;
-        simtime_t csBegin = loRaReception->getPreambleStartTime() + Tsym * (nPreamble - 6);
-        if(csBegin < loRaInterference->getEndTime())
-        {
-            timingCollision = true;
-        }
-
-        if (overlap && frequencyCollision)
-        {
-            if(alohaChannelModel == true)
-            {
-                if(iAmGateway && (part == IRadioSignal::SIGNAL_PART_DATA || part == IRadioSignal::SIGNAL_PART_WHOLE)) const_cast<LoRaReceiver* >(this)->emit(LoRaReceptionCollision, true);
-                return true;
-            }
-            if(alohaChannelModel == false)
-            {
-                if(captureEffect == false && timingCollision)
-                {
-                    if(iAmGateway && (part == IRadioSignal::SIGNAL_PART_DATA || part == IRadioSignal::SIGNAL_PART_WHOLE)) const_cast<LoRaReceiver* >(this)->emit(LoRaReceptionCollision, true);
-                    return true;
-                }
-            }
-
-        }
+        if(iAmGateway && (part == IRadioSignal::SIGNAL_PART_DATA || part == IRadioSignal::SIGNAL_PART_WHOLE)) const_cast<LoRaReceiver* >(this)->emit(LoRaReceptionCollision, true);
+        return true;
     }
     return false;
 }
@@ -216,10 +195,11 @@ const IReceptionDecision *LoRaReceiver::computeReceptionDecision(const IListenin
 
 Packet *LoRaReceiver::computeReceivedPacket(const ISnir *snir, bool isReceptionSuccessful) const
 {
+    // the chunks are immutable, so every receiver shares the content of the
+    // transmitted packet; only the packet itself and the receiver's tags are new
     auto transmittedPacket = snir->getReception()->getTransmission()->getPacket();
-    auto receivedPacket = transmittedPacket->dup();
-    receivedPacket->clearTags();
-//    receivedPacket->addTag<PacketProtocolTag>()->setProtocol(transmittedPacket->getTag<PacketProtocolTag>()->getProtocol());
+    auto receivedPacket = new Packet(transmittedPacket->getName(), transmittedPacket->peekAll());
+    receivedPacket->setKind(transmittedPacket->getKind());
     if (!isReceptionSuccessful)
         receivedPacket->setBitError(true);
     return receivedPacket;
@@ -248,7 +228,7 @@ const IReceptionResult *LoRaReceiver::computeReceptionResult(const IListening *l
     errorRateInd->setBitErrorRate(errorModel ? errorModel->computeBitErrorRate(snir, IRadioSignal::SIGNAL_PART_WHOLE) : 0.0);
     errorRateInd->setSymbolErrorRate(errorModel ? errorModel->computeSymbolErrorRate(snir, IRadioSignal::SIGNAL_PART_WHOLE) : 0.0);
 
-    return new ReceptionResult(reception, decisions, packet);
+    return new LoRaReceptionResult(reception, decisions, packet);
 }
 
 bool LoRaReceiver::computeIsReceptionSuccessful(const IListening *listening, const IReception *reception, IRadioSignal::SignalPart part, const IInterference *interference, const ISnir *snir) const
@@ -261,9 +241,6 @@ const IListening *LoRaReceiver::createListening(const IRadio *radio, const simti
 {
     if(iAmGateway == false)
     {
-        auto node = getContainingNode(this);
-//        auto loRaApp = check_and_cast<SimpleLoRaApp *>(node->getSubmodule("SimpleLoRaApp"));
-        auto loRaRadio = check_and_cast<LoRaRadio *>(node->getSubmodule("LoRaNic")->getSubmodule("radio"));
         return new LoRaBandListening(radio, startTime, endTime, startPosition, endPosition, loRaRadio->loRaCF, loRaRadio->loRaBW, loRaRadio->loRaSF);
     }
     else {
@@ -275,12 +252,9 @@ const IListeningDecision *LoRaReceiver::computeListeningDecision(const IListenin
 {
     const IRadio *receiver = listening->getReceiver();
     const IRadioMedium *radioMedium = receiver->getMedium();
-    const IAnalogModel *analogModel = radioMedium->getAnalogModel();
-    const INoise *noise = analogModel->computeNoise(listening, interference);
-    const ScalarNoise *loRaNoise = check_and_cast<const ScalarNoise *>(noise);
-    W maxPower = loRaNoise->computeMaxPower(listening->getStartTime(), listening->getEndTime());
+    const LoRaAnalogModel *analogModel = check_and_cast<const LoRaAnalogModel *>(radioMedium->getAnalogModel());
+    W maxPower = analogModel->computeMaxNoisePower(check_and_cast<const LoRaBandListening *>(listening), interference);
     bool isListeningPossible = maxPower >= energyDetection;
-    delete noise;
     EV_DEBUG << "Computing whether listening is possible: maximum power = " << maxPower << ", energy detection = " << energyDetection << " -> listening is " << (isListeningPossible ? "possible" : "impossible") << endl;
     return new ListeningDecision(listening, isListeningPossible);
 }
@@ -288,53 +262,7 @@ const IListeningDecision *LoRaReceiver::computeListeningDecision(const IListenin
 W LoRaReceiver::getSensitivity(const LoRaReception *reception) const
 {
     //function returns sensitivity -- according to LoRa documentation, it changes with LoRa parameters
-    //Sensitivity values from Semtech SX1272/73 datasheet, table 10, Rev 3.1, March 2017
-    W sensitivity = W(math::dBmW2mW(-126.5) / 1000);
-    if(reception->getLoRaSF() == 6)
-    {
-        if(reception->getLoRaBW() == Hz(125000)) sensitivity = W(math::dBmW2mW(-121) / 1000);
-        if(reception->getLoRaBW() == Hz(250000)) sensitivity = W(math::dBmW2mW(-118) / 1000);
-        if(reception->getLoRaBW() == Hz(500000)) sensitivity = W(math::dBmW2mW(-111) / 1000);
-    }
-
-    if (reception->getLoRaSF() == 7)
-    {
-        if(reception->getLoRaBW() == Hz(125000)) sensitivity = W(math::dBmW2mW(-124) / 1000);
-        if(reception->getLoRaBW() == Hz(250000)) sensitivity = W(math::dBmW2mW(-122) / 1000);
-        if(reception->getLoRaBW() == Hz(500000)) sensitivity = W(math::dBmW2mW(-116) / 1000);
-    }
-
-    if(reception->getLoRaSF() == 8)
-    {
-        if(reception->getLoRaBW() == Hz(125000)) sensitivity = W(math::dBmW2mW(-127) / 1000);
-        if(reception->getLoRaBW() == Hz(250000)) sensitivity = W(math::dBmW2mW(-125) / 1000);
-        if(reception->getLoRaBW() == Hz(500000)) sensitivity = W(math::dBmW2mW(-119) / 1000);
-    }
-    if(reception->getLoRaSF() == 9)
-    {
-        if(reception->getLoRaBW() == Hz(125000)) sensitivity = W(math::dBmW2mW(-130) / 1000);
-        if(reception->getLoRaBW() == Hz(250000)) sensitivity = W(math::dBmW2mW(-128) / 1000);
-        if(reception->getLoRaBW() == Hz(500000)) sensitivity = W(math::dBmW2mW(-122) / 1000);
-    }
-    if(reception->getLoRaSF() == 10)
-    {
-        if(reception->getLoRaBW() == Hz(125000)) sensitivity = W(math::dBmW2mW(-133) / 1000);
-        if(reception->getLoRaBW() == Hz(250000)) sensitivity = W(math::dBmW2mW(-130) / 1000);
-        if(reception->getLoRaBW() == Hz(500000)) sensitivity = W(math::dBmW2mW(-125) / 1000);
-    }
-    if(reception->getLoRaSF() == 11)
-    {
-        if(reception->getLoRaBW() == Hz(125000)) sensitivity = W(math::dBmW2mW(-135) / 1000);
-        if(reception->getLoRaBW() == Hz(250000)) sensitivity = W(math::dBmW2mW(-132) / 1000);
-        if(reception->getLoRaBW() == Hz(500000)) sensitivity = W(math::dBmW2mW(-128) / 1000);
-    }
-    if(reception->getLoRaSF() == 12)
-    {
-        if(reception->getLoRaBW() == Hz(125000)) sensitivity = W(math::dBmW2mW(-137) / 1000);
-        if(reception->getLoRaBW() == Hz(250000)) sensitivity = W(math::dBmW2mW(-135) / 1000);
-        if(reception->getLoRaBW() == Hz(500000)) sensitivity = W(math::dBmW2mW(-129) / 1000);
-    }
-    return sensitivity;
+    return sensitivityTable.getSensitivity(reception->getLoRaSF(), reception->getLoRaBW());
 }
 
 }
@@ -28,6 +28,7 @@
 #include "LoRaTransmission.h"
 #include "LoRaReception.h"
 #include "LoRaBandListening.h"
+#include "LoRaSensitivityTable.h"
 #include "LoRa/LoRaRadio.h"
 #include "LoRaApp/SimpleLoRaApp.h"
 #include "LoRa/LoRaMac.h"
@@ -55,6 +56,13 @@ private:
     bool iAmGateway;
     bool alohaChannelModel;
 
+    // resolved at initialization, the end node or the gateway ones are set
+    LoRaRadio *loRaRadio = nullptr;
+    LoRaMac *loRaMac = nullptr;
+    LoRaGWMac *loRaGWMac = nullptr;
+
+    LoRaSensitivityTable sensitivityTable;
+
     simsignal_t LoRaReceptionCollision;
 
     int nonOrthDelta[6][6] = {
@@ -0,0 +1,44 @@
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see http://www.gnu.org/licenses/.
+//
+
+#ifndef LORAPHY_LORARECEPTIONRESULT_H_
+#define LORAPHY_LORARECEPTIONRESULT_H_
+
+#include "inet/physicallayer/wireless/common/radio/packetlevel/ReceptionResult.h"
+
+using namespace inet;
+using namespace inet::physicallayer;
+namespace flora {
+
+/**
+ * Reception result whose packet can be handed over to the receiver instead
+ * of being duplicated once more by the medium.
+ */
+class LoRaReceptionResult : public ReceptionResult
+{
+  public:
+    using ReceptionResult::ReceptionResult;
+
+    /** Returns the packet to the caller, who becomes its owner. */
+    Packet *releasePacket() {
+        auto releasedPacket = const_cast<Packet *>(packet);
+        packet = nullptr;
+        return releasedPacket;
+    }
+};
+
+} // namespace flora
+
+#endif /* LORAPHY_LORARECEPTIONRESULT_H_ */
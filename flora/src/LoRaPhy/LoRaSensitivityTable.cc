@@ -0,0 +1,67 @@
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+// 
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see http://www.gnu.org/licenses/.
+// 
+
+#include "LoRaSensitivityTable.h"
+
+namespace flora {
+
+LoRaSensitivityTable::LoRaSensitivityTable() :
+    defaultSensitivity(dBm2W(SX1272_DEFAULT_SENSITIVITY_DBM))
+{
+    for (int i = 0; i < LORA_NUM_SF; i++) {
+        for (int j = 0; j < LORA_NUM_BW; j++)
+            sensitivity[i][j] = dBm2W(SX1272_SENSITIVITY_DBM[i][j]);
+        requiredSNR[i] = LORA_REQUIRED_SNR_DB[i];
+    }
+}
+
+int LoRaSensitivityTable::getSFIndex(const cXMLElement *element)
+{
+    const char *sf = element->getAttribute("sf");
+    if (sf == nullptr)
+        throw cRuntimeError("Missing sf attribute at %s", element->getSourceLocation());
+    int value = atoi(sf);
+    if (value < LORA_MIN_SF || value > LORA_MAX_SF)
+        throw cRuntimeError("Invalid sf %d at %s", value, element->getSourceLocation());
+    return value - LORA_MIN_SF;
+}
+
+void LoRaSensitivityTable::parse(const cXMLElement *xml)
+{
+    if (xml == nullptr)
+        return;
+    if (const char *str = xml->getAttribute("default"))
+        defaultSensitivity = dBm2W(strtod(str, nullptr));
+    for (auto element : xml->getChildrenByTagName("sensitivity")) {
+        int sfIndex = getSFIndex(element);
+        const char *bw = element->getAttribute("bw");
+        const char *value = element->getAttribute("value");
+        if (bw == nullptr || value == nullptr)
+            throw cRuntimeError("Missing bw or value attribute at %s", element->getSourceLocation());
+        int bandwidthIndex = getBandwidthIndex(Hz(strtod(bw, nullptr)));
+        if (bandwidthIndex < 0)
+            throw cRuntimeError("Unsupported bandwidth %s at %s", bw, element->getSourceLocation());
+        sensitivity[sfIndex][bandwidthIndex] = dBm2W(strtod(value, nullptr));
+    }
+    for (auto element : xml->getChildrenByTagName("requiredSNR")) {
+        int sfIndex = getSFIndex(element);
+        const char *value = element->getAttribute("value");
+        if (value == nullptr)
+            throw cRuntimeError("Missing value attribute at %s", element->getSourceLocation());
+        requiredSNR[sfIndex] = strtod(value, nullptr);
+    }
+}
+
+} // namespace flora
@@ -0,0 +1,102 @@
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+// 
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see http://www.gnu.org/licenses/.
+// 
+
+#ifndef LORAPHY_LORASENSITIVITYTABLE_H_
+#define LORAPHY_LORASENSITIVITYTABLE_H_
+
+#include "inet/common/INETDefs.h"
+#include "inet/common/INETMath.h"
+#include "inet/common/Units.h"
+
+namespace flora {
+
+using namespace inet;
+using namespace inet::units::values;
+
+constexpr int LORA_MIN_SF = 6;
+constexpr int LORA_MAX_SF = 12;
+constexpr int LORA_NUM_SF = LORA_MAX_SF - LORA_MIN_SF + 1;
+constexpr int LORA_NUM_BW = 3;
+
+constexpr double LORA_BANDWIDTHS[LORA_NUM_BW] = {125000, 250000, 500000};
+
+//Sensitivity values from Semtech SX1272/73 datasheet, table 10, Rev 3.1, March 2017
+//rows are SF6 ... SF12, columns are 125, 250 and 500 kHz
+constexpr double SX1272_SENSITIVITY_DBM[LORA_NUM_SF][LORA_NUM_BW] = {
+    {-121, -118, -111},
+    {-124, -122, -116},
+    {-127, -125, -119},
+    {-130, -128, -122},
+    {-133, -130, -125},
+    {-135, -132, -128},
+    {-137, -135, -129}
+};
+constexpr double SX1272_DEFAULT_SENSITIVITY_DBM = -126.5;
+
+//demodulator SNR limits per SF (SF6 ... SF12) used by ADR
+constexpr double LORA_REQUIRED_SNR_DB[LORA_NUM_SF] = {-5, -7.5, -10, -12.5, -15, -17.5, -20};
+
+/**
+ * Sensitivity (also used as background noise floor) per SF and bandwidth,
+ * and the required SNR per SF. The values are kept in watts so that lookups
+ * on the reception path are plain array accesses; the SX1272 constants above
+ * are the defaults and can be overridden from XML:
+ *
+ * <sensitivityTable default="-126.5">
+ *     <sensitivity sf="7" bw="125000" value="-124"/>   <!-- dBm -->
+ *     <requiredSNR sf="7" value="-7.5"/>                <!-- dB -->
+ * </sensitivityTable>
+ */
+class LoRaSensitivityTable
+{
+  protected:
+    W sensitivity[LORA_NUM_SF][LORA_NUM_BW];
+    W defaultSensitivity;
+    double requiredSNR[LORA_NUM_SF];
+
+  protected:
+    static W dBm2W(double dBm) { return W(math::dBmW2mW(dBm) / 1000); }
+    static int getSFIndex(const cXMLElement *element);
+
+  public:
+    LoRaSensitivityTable();
+
+    /** Overrides the entries present in the given XML element. */
+    void parse(const cXMLElement *xml);
+
+    static int getBandwidthIndex(Hz bandwidth) {
+        for (int i = 0; i < LORA_NUM_BW; i++)
+            if (bandwidth.get() == LORA_BANDWIDTHS[i])
+                return i;
+        return -1;
+    }
+
+    W getSensitivity(int sf, Hz bandwidth) const {
+        int bandwidthIndex = getBandwidthIndex(bandwidth);
+        if (sf < LORA_MIN_SF || sf > LORA_MAX_SF || bandwidthIndex < 0)
+            return defaultSensitivity;
+        return sensitivity[sf - LORA_MIN_SF][bandwidthIndex];
+    }
+
+    double getRequiredSNR(int sf) const {
+        if (sf < LORA_MIN_SF || sf > LORA_MAX_SF)
+            throw cRuntimeError("No required SNR for SF %d", sf);
+        return requiredSNR[sf - LORA_MIN_SF];
+    }
+};
+
+} // namespace flora
+
+#endif /* LORAPHY_LORASENSITIVITYTABLE_H_ */
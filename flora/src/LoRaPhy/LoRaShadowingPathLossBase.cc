@@ -0,0 +1,54 @@
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see http://www.gnu.org/licenses/.
+//
+
+#include "LoRaShadowingPathLossBase.h"
+
+namespace flora {
+
+void LoRaShadowingPathLossBase::initialize(int stage)
+{
+    FreeSpacePathLoss::initialize(stage);
+    if (stage == INITSTAGE_LOCAL) {
+        sigma = par("sigma");
+        counterBasedShadowing = par("counterBasedShadowing");
+        // the key comes from the module's RNG, so seed sets still select the realization
+        if (counterBasedShadowing) {
+            uint64_t seed = getRNG(0)->intRand();
+            seed = (seed << 32) | getRNG(0)->intRand();
+            shadowingRng.setSeed(seed);
+        }
+    }
+}
+
+double LoRaShadowingPathLossBase::computeShadowing(int transmissionId, int receiverId) const
+{
+    if (!counterBasedShadowing)
+        return normal(0.0, sigma);
+    return sigma * shadowingRng.normal((uint32_t)transmissionId, receiverId);
+}
+
+void LoRaShadowingPathLossBase::computeShadowing(int transmissionId, const int *receiverIds, double *shadowing, int count) const
+{
+    if (!counterBasedShadowing) {
+        for (int i = 0; i < count; i++)
+            shadowing[i] = normal(0.0, sigma);
+        return;
+    }
+    shadowingRng.normal((uint32_t)transmissionId, receiverIds, shadowing, count);
+    for (int i = 0; i < count; i++)
+        shadowing[i] *= sigma;
+}
+
+} // namespace flora
@@ -0,0 +1,49 @@
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see http://www.gnu.org/licenses/.
+//
+
+#ifndef LORAPHY_LORASHADOWINGPATHLOSSBASE_H_
+#define LORAPHY_LORASHADOWINGPATHLOSSBASE_H_
+
+#include "inet/physicallayer/wireless/common/pathloss/FreeSpacePathLoss.h"
+#include "LoRaPhy/ILoRaShadowingPathLoss.h"
+#include "LoRaPhy/LoRaCounterRng.h"
+
+using namespace inet;
+using namespace inet::physicallayer;
+namespace flora {
+
+/**
+ * Zero mean normal shadowing with the sigma and counterBasedShadowing
+ * parameters, shared by the LoRa path loss models.
+ */
+class LoRaShadowingPathLossBase : public FreeSpacePathLoss, public ILoRaShadowingPathLoss
+{
+  protected:
+    double sigma;
+    bool counterBasedShadowing = false;
+    LoRaCounterRng shadowingRng;
+
+  protected:
+    virtual void initialize(int stage) override;
+
+  public:
+    virtual bool isCounterBasedShadowing() const override { return counterBasedShadowing; }
+    virtual double computeShadowing(int transmissionId, int receiverId) const override;
+    virtual void computeShadowing(int transmissionId, const int *receiverIds, double *shadowing, int count) const override;
+};
+
+} // namespace flora
+
+#endif /* LORAPHY_LORASHADOWINGPATHLOSSBASE_H_ */
@@ -0,0 +1,220 @@
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see http://www.gnu.org/licenses/.
+//
+
+#include "LoRaTerrainPathLoss.h"
+#include "inet/common/INETMath.h"
+#include "inet/common/ModuleAccess.h"
+#include "LoRa/LoRaGWRadio.h"
+#include <fstream>
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace flora {
+
+Define_Module(LoRaTerrainPathLoss);
+
+static const double EFFECTIVE_EARTH_RADIUS = 4.0 / 3.0 * 6371000; // m
+static const int SRTM_VOID = -32768;
+static const double SPEED_OF_LIGHT_MPS = 299792458;
+
+LoRaTerrainPathLoss::~LoRaTerrainPathLoss()
+{
+#ifndef _WIN32
+    for (auto& it : tiles)
+        if (it.second.buffer.empty() && it.second.samples != nullptr)
+            munmap(const_cast<uint8_t *>(it.second.samples), it.second.length);
+#endif
+}
+
+void LoRaTerrainPathLoss::initialize(int stage)
+{
+    PathLossBase::initialize(stage);
+    if (stage == INITSTAGE_LOCAL) {
+        basePathLoss = check_and_cast<IPathLoss *>(getSubmodule("pathLoss"));
+        endNodeMastHeight = m(par("endNodeMastHeight"));
+        gatewayMastHeight = m(par("gatewayMastHeight"));
+        profileStep = m(par("profileStep"));
+        if (!(profileStep > m(0)))
+            throw cRuntimeError("The terrain profile step must be positive");
+        cStringTokenizer tokenizer(par("demFiles"));
+        while (tokenizer.hasMoreTokens())
+            loadTile(tokenizer.nextToken());
+    }
+    else if (stage == INITSTAGE_PHYSICAL_ENVIRONMENT && !tiles.empty())
+        coordinateSystem = getModuleFromPar<IGeographicCoordinateSystem>(par("coordinateSystemModule"), this);
+}
+
+void LoRaTerrainPathLoss::finish()
+{
+    recordScalar("terrain loss computation count", linkLossComputationCount);
+    recordScalar("terrain loss cache hit count", linkLossCacheHitCount);
+}
+
+void LoRaTerrainPathLoss::loadTile(const char *fileName)
+{
+    // SRTM naming: the south west corner, e.g. S04E114.hgt
+    const char *baseName = strrchr(fileName, '/');
+    baseName = baseName != nullptr ? baseName + 1 : fileName;
+    char latitudeHemisphere, longitudeHemisphere;
+    int latitude, longitude;
+    if (sscanf(baseName, "%c%2d%c%3d", &latitudeHemisphere, &latitude, &longitudeHemisphere, &longitude) != 4
+            || (toupper(latitudeHemisphere) != 'N' && toupper(latitudeHemisphere) != 'S')
+            || (toupper(longitudeHemisphere) != 'E' && toupper(longitudeHemisphere) != 'W'))
+        throw cRuntimeError("Cannot derive the tile position from the DEM file name '%s', expected e.g. S04E114.hgt", fileName);
+    if (toupper(latitudeHemisphere) == 'S')
+        latitude = -latitude;
+    if (toupper(longitudeHemisphere) == 'W')
+        longitude = -longitude;
+    DemTile& tile = tiles[getTileKey(latitude, longitude)];
+    if (tile.samples != nullptr)
+        throw cRuntimeError("DEM tile '%s' is given twice", fileName);
+    struct stat fileStat;
+    if (stat(fileName, &fileStat) != 0)
+        throw cRuntimeError("Cannot open DEM file '%s'", fileName);
+    tile.length = fileStat.st_size;
+    tile.size = (int)std::lround(std::sqrt(tile.length / 2.0));
+    if (tile.size < 2 || (size_t)tile.size * tile.size * 2 != tile.length)
+        throw cRuntimeError("DEM file '%s' is not a square grid of 16 bit samples", fileName);
+#ifndef _WIN32
+    int fd = open(fileName, O_RDONLY);
+    if (fd >= 0) {
+        void *mapping = mmap(nullptr, tile.length, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (mapping != MAP_FAILED) {
+            tile.samples = static_cast<const uint8_t *>(mapping);
+            return;
+        }
+    }
+#endif
+    std::ifstream file(fileName, std::ios::binary);
+    tile.buffer.resize(tile.length);
+    if (!file.read(reinterpret_cast<char *>(tile.buffer.data()), tile.length))
+        throw cRuntimeError("Cannot read DEM file '%s'", fileName);
+    tile.samples = tile.buffer.data();
+}
+
+m LoRaTerrainPathLoss::getTerrainHeight(const Coord& position) const
+{
+    if (tiles.empty())
+        return m(0);
+    GeoCoord geoCoord = coordinateSystem->computeGeographicCoordinate(position);
+    double latitude = deg(geoCoord.latitude).get();
+    double longitude = deg(geoCoord.longitude).get();
+    int tileLatitude = (int)std::floor(latitude);
+    int tileLongitude = (int)std::floor(longitude);
+    auto it = tiles.find(getTileKey(tileLatitude, tileLongitude));
+    if (it == tiles.end())
+        return m(0);
+    const DemTile& tile = it->second;
+    int last = tile.size - 1;
+    double x = (longitude - tileLongitude) * last;
+    double y = (tileLatitude + 1 - latitude) * last;
+    int column = std::min(last - 1, std::max(0, (int)x));
+    int row = std::min(last - 1, std::max(0, (int)y));
+    double fx = x - column;
+    double fy = y - row;
+    auto sample = [&] (int r, int c) {
+        const uint8_t *bytes = tile.samples + 2 * ((size_t)r * tile.size + c);
+        int height = (int16_t)((bytes[0] << 8) | bytes[1]);
+        return height == SRTM_VOID ? 0.0 : (double)height;
+    };
+    double height = (1 - fy) * ((1 - fx) * sample(row, column) + fx * sample(row, column + 1))
+            + fy * ((1 - fx) * sample(row + 1, column) + fx * sample(row + 1, column + 1));
+    return m(height);
+}
+
+m LoRaTerrainPathLoss::getMastHeight(const IRadio *radio) const
+{
+    return dynamic_cast<const LoRaGWRadio *>(radio) != nullptr ? gatewayMastHeight : endNodeMastHeight;
+}
+
+double LoRaTerrainPathLoss::computeDiffractionLoss(const std::vector<double>& heights, double step, double wavelength, int first, int last, int depth) const
+{
+    // heights[first] and heights[last] are the antennas, the others the terrain
+    double distance = (last - first) * step;
+    double maxNu = -INFINITY;
+    int edge = -1;
+    for (int i = first + 1; i < last; i++) {
+        double d1 = (i - first) * step;
+        double d2 = distance - d1;
+        double lineHeight = heights[first] + (heights[last] - heights[first]) * d1 / distance;
+        double clearance = heights[i] + d1 * d2 / (2 * EFFECTIVE_EARTH_RADIUS) - lineHeight;
+        double nu = clearance * std::sqrt(2 * distance / (wavelength * d1 * d2));
+        if (nu > maxNu) {
+            maxNu = nu;
+            edge = i;
+        }
+    }
+    // no loss below nu = -0.78, i.e. with about half of the first Fresnel zone clear
+    if (edge < 0 || maxNu <= -0.78)
+        return 0;
+    double loss = 6.9 + 20 * std::log10(std::sqrt((maxNu - 0.1) * (maxNu - 0.1) + 1) + maxNu - 0.1);
+    if (depth > 0) {
+        // the main edge is an end point of both sub-paths
+        loss += computeDiffractionLoss(heights, step, wavelength, first, edge, depth - 1);
+        loss += computeDiffractionLoss(heights, step, wavelength, edge, last, depth - 1);
+    }
+    return loss;
+}
+
+double LoRaTerrainPathLoss::computeTerrainLoss(const IRadio *transmitterRadio, const Coord& transmitterPosition, const IRadio *receiverRadio, const Coord& receiverPosition, Hz frequency) const
+{
+    if (tiles.empty())
+        return 1;
+    uint64_t key = getLinkKey(transmitterRadio->getId(), receiverRadio->getId());
+    {
+        std::lock_guard<std::mutex> lock(linkLossCacheMutex);
+        auto it = linkLossCache.find(key);
+        if (it != linkLossCache.end() && it->second.transmitterPosition == transmitterPosition
+                && it->second.receiverPosition == receiverPosition && it->second.frequency == frequency)
+        {
+            linkLossCacheHitCount++;
+            return it->second.loss;
+        }
+    }
+    linkLossComputationCount++;
+    // profile of the ground projection, sampled at least every profileStep
+    double distance = std::sqrt((receiverPosition.x - transmitterPosition.x) * (receiverPosition.x - transmitterPosition.x)
+            + (receiverPosition.y - transmitterPosition.y) * (receiverPosition.y - transmitterPosition.y));
+    int numSteps = std::max(2, (int)std::ceil(distance / profileStep.get()));
+    double step = distance / numSteps;
+    std::vector<double> heights(numSteps + 1);
+    for (int i = 0; i <= numSteps; i++)
+        heights[i] = getTerrainHeight(transmitterPosition + (receiverPosition - transmitterPosition) * ((double)i / numSteps)).get();
+    heights[0] += (getMastHeight(transmitterRadio) + m(transmitterPosition.z)).get();
+    heights[numSteps] += (getMastHeight(receiverRadio) + m(receiverPosition.z)).get();
+    double wavelength = SPEED_OF_LIGHT_MPS / frequency.get();
+    double loss = distance > 0 ? math::dB2fraction(-computeDiffractionLoss(heights, step, wavelength, 0, numSteps, 1)) : 1;
+    std::lock_guard<std::mutex> lock(linkLossCacheMutex);
+    linkLossCache[key] = {transmitterPosition, receiverPosition, frequency, loss};
+    return loss;
+}
+
+std::ostream& LoRaTerrainPathLoss::printToStream(std::ostream& stream, int level, int evFlags) const
+{
+    stream << "LoRaTerrainPathLoss";
+    if (level <= PRINT_LEVEL_TRACE)
+        stream << ", basePathLoss = " << printFieldToString(basePathLoss, level + 1, evFlags)
+               << ", numTiles = " << tiles.size()
+               << ", endNodeMastHeight = " << endNodeMastHeight
+               << ", gatewayMastHeight = " << gatewayMastHeight;
+    return stream;
+}
+
+} // namespace flora
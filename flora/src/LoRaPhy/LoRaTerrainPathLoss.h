@@ -0,0 +1,111 @@
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see http://www.gnu.org/licenses/.
+//
+
+#ifndef LORAPHY_LORATERRAINPATHLOSS_H_
+#define LORAPHY_LORATERRAINPATHLOSS_H_
+
+#include "inet/common/geometry/common/GeographicCoordinateSystem.h"
+#include "inet/physicallayer/wireless/common/base/packetlevel/PathLossBase.h"
+#include "inet/physicallayer/wireless/common/contract/packetlevel/IRadio.h"
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+using namespace inet;
+using namespace inet::physicallayer;
+namespace flora {
+
+/**
+ * Decorates the path loss submodule with the diffraction loss over the
+ * terrain between the antennas. Terrain heights come from memory mapped
+ * SRTM height tiles (.hgt), looked up through the scene's geographic
+ * coordinate system. Within the terrain profile the antennas stand on the
+ * terrain, raised by the z coordinate of the mobility plus the mast height
+ * of the end node or gateway. The loss along the profile follows the Deygout
+ * construction (ITU-R P.526) with the main edge and one sub-edge on each
+ * side, on an earth with 4/3 effective radius.
+ *
+ * The IPathLoss methods only forward to the base path loss; the analog
+ * model multiplies computeTerrainLoss() in, which is cached per link. The
+ * terrain and mast heights only enter the diffraction loss: the base path
+ * loss and the antenna gains still see the scene positions, so the heights
+ * change neither the line of sight distance nor the elevation angle.
+ * Without DEM tiles the terrain loss is 1 and no coordinate system is needed.
+ */
+class LoRaTerrainPathLoss : public PathLossBase
+{
+  protected:
+    struct DemTile {
+        int size = 0;                    // samples per side
+        const uint8_t *samples = nullptr; // big endian int16, rows from north to south
+        size_t length = 0;
+        std::vector<uint8_t> buffer;     // when the file could not be mapped
+    };
+
+    struct LinkLoss {
+        Coord transmitterPosition;
+        Coord receiverPosition;
+        Hz frequency;
+        double loss;
+    };
+
+  protected:
+    IPathLoss *basePathLoss = nullptr;
+    IGeographicCoordinateSystem *coordinateSystem = nullptr;
+    m endNodeMastHeight = m(NaN);
+    m gatewayMastHeight = m(NaN);
+    m profileStep = m(NaN);
+    /** Tiles keyed on the latitude and longitude of their south west corner. */
+    std::unordered_map<int64_t, DemTile> tiles;
+
+    /** Keyed on (transmitter id, receiver id), entries are recomputed when the antennas moved. */
+    mutable std::unordered_map<uint64_t, LinkLoss> linkLossCache;
+    // receptions may be computed on the worker threads of the medium
+    mutable std::mutex linkLossCacheMutex;
+    mutable std::atomic<long> linkLossComputationCount{0};
+    mutable std::atomic<long> linkLossCacheHitCount{0};
+
+  protected:
+    virtual int numInitStages() const override { return NUM_INIT_STAGES; }
+    virtual void initialize(int stage) override;
+    virtual void finish() override;
+
+    virtual void loadTile(const char *fileName);
+    static int64_t getTileKey(int latitude, int longitude) { return ((int64_t)latitude << 32) | (uint32_t)longitude; }
+    static uint64_t getLinkKey(int transmitterId, int receiverId) { return ((uint64_t)(uint32_t)transmitterId << 32) | (uint32_t)receiverId; }
+
+    virtual m getMastHeight(const IRadio *radio) const;
+    /** Diffraction loss in dB of the profile between the samples first and last. */
+    virtual double computeDiffractionLoss(const std::vector<double>& heights, double step, double wavelength, int first, int last, int depth) const;
+
+  public:
+    virtual ~LoRaTerrainPathLoss();
+
+    const IPathLoss *getBasePathLoss() const { return basePathLoss; }
+    /** Terrain height above sea level at the given scene position, 0 outside the tiles. */
+    virtual m getTerrainHeight(const Coord& position) const;
+    /** Diffraction loss over the terrain as a fraction. */
+    virtual double computeTerrainLoss(const IRadio *transmitterRadio, const Coord& transmitterPosition, const IRadio *receiverRadio, const Coord& receiverPosition, Hz frequency) const;
+
+    virtual std::ostream& printToStream(std::ostream& stream, int level, int evFlags = 0) const override;
+    virtual double computePathLoss(const ITransmission *transmission, const IArrival *arrival) const override { return basePathLoss->computePathLoss(transmission, arrival); }
+    virtual double computePathLoss(mps propagationSpeed, Hz frequency, m distance) const override { return basePathLoss->computePathLoss(propagationSpeed, frequency, distance); }
+    virtual m computeRange(mps propagationSpeed, Hz frequency, double loss) const override { return basePathLoss->computeRange(propagationSpeed, frequency, loss); }
+};
+
+} // namespace flora
+
+#endif /* LORAPHY_LORATERRAINPATHLOSS_H_ */
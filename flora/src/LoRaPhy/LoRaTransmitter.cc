@@ -16,6 +16,7 @@
 #include "LoRaTransmitter.h"
 #include "inet/physicallayer/wireless/common/analogmodel/packetlevel/ScalarTransmission.h"
 #include "LoRaModulation.h"
+#include "LoRaAirtime.h"
 #include "LoRaPhyPreamble_m.h"
 #include <algorithm>
 
@@ -45,6 +46,8 @@ void LoRaTransmitter::initialize(int stage)
         {
             iAmGateway = true;
         } else iAmGateway = false;
+        if (!iAmGateway)
+            loRaRadio = check_and_cast<LoRaRadio *>(getParentModule());
     }
 }
 
@@ -60,24 +63,18 @@ const ITransmission *LoRaTransmitter::createTransmission(const IRadio *transmitt
     //W transmissionPower = controlInfo && !std::isnan(controlInfo->getPower().get()) ? controlInfo->getPower() : power;
     const_cast<LoRaTransmitter* >(this)->emit(LoRaTransmissionCreated, true);
 //    const LoRaMacFrame *frame = check_and_cast<const LoRaMacFrame *>(macFrame);
-    EV << macFrame->getDetailStringRepresentation(evFlags) << endl;
+    EV_DEBUG << macFrame->getDetailStringRepresentation(evFlags) << endl;
     const auto &frame = macFrame->peekAtFront<LoRaPhyPreamble>();
+    const LoRaPhyParameters& phy = frame->getPhy();
 
-    int nPreamble = 8;
-    simtime_t Tsym = (pow(2, frame->getSpreadFactor()))/(frame->getBandwidth().get()/1000);
-    simtime_t Tpreamble = (nPreamble + 4.25) * Tsym / 1000;
-
-    //preambleDuration = Tpreamble;
-    int payloadBytes = 0;
-    if(iAmGateway) payloadBytes = 15;
-    else payloadBytes = 20;
-    int payloadSymbNb = 8;
-    payloadSymbNb += std::ceil((8*payloadBytes - 4*frame->getSpreadFactor() + 28 + 16 - 20*0)/(4*(frame->getSpreadFactor()-2*0)))*(frame->getCodeRendundance() + 4);
-    if(payloadSymbNb < 8) payloadSymbNb = 8;
-    simtime_t Theader = 0.5 * (8+payloadSymbNb) * Tsym / 1000;
-    simtime_t Tpayload = 0.5 * (8+payloadSymbNb) * Tsym / 1000;
-
-    const simtime_t duration = Tpreamble + Theader + Tpayload;
+    //the PHY preamble chunk only carries the signal parameters, everything behind it is PHY payload
+    int payloadBytes = B(macFrame->getDataLength() - frame->getChunkLength()).get();
+    const LoRaAirtime airtime = computeLoRaAirtime(phy.getSpreadFactor(), phy.getBandwidth(), phy.getCodeRendundance(), payloadBytes, phy.getUseHeader());
+    const simtime_t Tpreamble = airtime.preamble;
+    const simtime_t Theader = airtime.header;
+    const simtime_t Tpayload = airtime.payload;
+
+    const simtime_t duration = airtime.getDuration();
     const simtime_t endTime = startTime + duration;
     IMobility *mobility = transmitter->getAntenna()->getMobility();
     const Coord startPosition = mobility->getCurrentPosition();
@@ -87,14 +84,12 @@ const ITransmission *LoRaTransmitter::createTransmission(const IRadio *transmitt
     W transmissionPower = computeTransmissionPower(macFrame);
 
     if(!iAmGateway) {
-        LoRaRadio *radio = check_and_cast<LoRaRadio *>(getParentModule());
-        transmissionPower = mW(math::dBmW2mW(radio->loRaTP));
+        transmissionPower = mW(math::dBmW2mW(loRaRadio->loRaTP));
     }
     else
         transmissionPower = mW(math::dBmW2mW(14));
 
-    EV << "[MSDebug] I am sending packet with TP: " << transmissionPower << endl;
-    EV << "[MSDebug] I am sending packet with SF: " << frame->getSpreadFactor() << endl;
+    EV_DEBUG << "Sending packet with TP: " << transmissionPower << ", SF: " << phy.getSpreadFactor() << endl;
 
 
     return new LoRaTransmission(transmitter,
@@ -109,9 +104,9 @@ const ITransmission *LoRaTransmitter::createTransmission(const IRadio *transmitt
             startOrientation,
             endOrientation,
             transmissionPower,
-            frame->getCenterFrequency(),
-            frame->getSpreadFactor(),
-            frame->getBandwidth(),
-            frame->getCodeRendundance());}
+            phy.getCenterFrequency(),
+            phy.getSpreadFactor(),
+            phy.getBandwidth(),
+            phy.getCodeRendundance());}
 
 }
@@ -34,6 +34,7 @@ class LoRaTransmitter : public FlatTransmitterBase {
     private:
 
         bool iAmGateway;
+        LoRaRadio *loRaRadio = nullptr; // end nodes only
 
         simsignal_t LoRaTransmissionCreated;
 
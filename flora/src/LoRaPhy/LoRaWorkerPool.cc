@@ -0,0 +1,114 @@
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see http://www.gnu.org/licenses/.
+//
+
+#include "LoRaWorkerPool.h"
+
+namespace flora {
+
+LoRaWorkerPool::LoRaWorkerPool(int numThreads) :
+    nextIndex(0)
+{
+    for (int i = 1; i < numThreads; i++)
+        threads.emplace_back(&LoRaWorkerPool::workerMain, this);
+}
+
+LoRaWorkerPool::~LoRaWorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    startCondition.notify_all();
+    for (auto& thread : threads)
+        thread.join();
+}
+
+void LoRaWorkerPool::runChunks()
+{
+    while (true) {
+        int start = nextIndex.fetch_add(chunkSize, std::memory_order_relaxed);
+        if (start >= count)
+            return;
+        int end = std::min(start + chunkSize, count);
+        try {
+            for (int i = start; i < end; i++)
+                (*body)(i);
+        }
+        catch (...) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!exception)
+                exception = std::current_exception();
+            // skip the rest of the loop
+            nextIndex.store(count, std::memory_order_relaxed);
+            return;
+        }
+    }
+}
+
+void LoRaWorkerPool::workerMain()
+{
+    long seenGeneration = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            startCondition.wait(lock, [&] { return stopping || generation != seenGeneration; });
+            if (stopping)
+                return;
+            seenGeneration = generation;
+        }
+        runChunks();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            busyThreads--;
+        }
+        doneCondition.notify_one();
+    }
+}
+
+void LoRaWorkerPool::parallelFor(int count, const std::function<void (int)>& f)
+{
+    if (count <= 0)
+        return;
+    if (threads.empty()) {
+        for (int i = 0; i < count; i++)
+            f(i);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        body = &f;
+        this->count = count;
+        // several chunks per thread so that uneven iterations even out
+        chunkSize = std::max(1, count / (8 * getNumThreads()));
+        nextIndex.store(0, std::memory_order_relaxed);
+        exception = nullptr;
+        busyThreads = threads.size();
+        generation++;
+    }
+    startCondition.notify_all();
+    runChunks();
+    std::exception_ptr thrown;
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        doneCondition.wait(lock, [&] { return busyThreads == 0; });
+        body = nullptr;
+        thrown = exception;
+        exception = nullptr;
+    }
+    if (thrown)
+        std::rethrow_exception(thrown);
+}
+
+} // namespace flora
@@ -0,0 +1,74 @@
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see http://www.gnu.org/licenses/.
+//
+
+#ifndef LORAPHY_LORAWORKERPOOL_H_
+#define LORAPHY_LORAWORKERPOOL_H_
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace flora {
+
+/**
+ * Fixed set of worker threads running the iterations of one loop at a time.
+ * The calling thread takes part, and every thread claims small chunks of
+ * iterations from a shared atomic index until none are left, so threads that
+ * finish early take over the remaining work. The loop body must not touch
+ * the simulation kernel (no cObject creation, EV output, RNG or signals).
+ */
+class LoRaWorkerPool
+{
+  protected:
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable startCondition;
+    std::condition_variable doneCondition;
+    long generation = 0;
+    int busyThreads = 0;
+    bool stopping = false;
+
+    const std::function<void (int)> *body = nullptr;
+    int count = 0;
+    int chunkSize = 1;
+    std::atomic<int> nextIndex;
+    std::exception_ptr exception;
+
+  protected:
+    void runChunks();
+    void workerMain();
+
+  public:
+    /** Starts numThreads - 1 workers, the caller of parallelFor is the last one. */
+    explicit LoRaWorkerPool(int numThreads);
+    ~LoRaWorkerPool();
+
+    int getNumThreads() const { return threads.size() + 1; }
+
+    /**
+     * Calls f(0) ... f(count - 1) on the pool and returns when all calls have
+     * finished. The first exception thrown by f is rethrown here.
+     */
+    void parallelFor(int count, const std::function<void (int)>& f);
+};
+
+} // namespace flora
+
+#endif /* LORAPHY_LORAWORKERPOOL_H_ */